@@ -0,0 +1,64 @@
+import matplotlib.pyplot as plt
+import argparse
+
+from show import read_csv
+
+'''
+Compares the output.csv file of a simulation to the output.csv file of a
+reference simulation, for example to measure the accuracy of multi-rate
+steps, of the sparse matrix engine or of region aggregation against the default
+execution.
+
+For each of the S, I and R populations, the maximum error relative to the
+total population N of the reference simulation is printed. Only time
+steps available in both files are compared.
+'''
+def compare(reference_file, output_file):
+    reference = read_csv(reference_file)
+    output = read_csv(output_file)
+
+    reference_rows = dict(zip(reference[0], range(0, len(reference[0]))))
+    steps = []
+    errors = [[], [], []]
+    for (i, t) in enumerate(output[0]):
+        if t in reference_rows:
+            j = reference_rows[t]
+            steps.append(t)
+            for k in range(0, 3):
+                errors[k].append(abs(output[k+1][i] - reference[k+1][j]) / reference[4][j])
+
+    for (k, label) in enumerate(["S", "I", "R"]):
+        max_error = max(errors[k]) if len(errors[k]) > 0 else 0
+        print(label + ": max relative error = " + str(max_error))
+    return (steps, errors)
+
+def plot(steps, errors):
+    plt.figure()
+    plt.title("Error relative to the total population")
+    plt.plot(steps, errors[0], label="Susceptible")
+    plt.plot(steps, errors[1], label="Infected")
+    plt.plot(steps, errors[2], label="Removed")
+    plt.xlabel("Time Step")
+    plt.yscale("log")
+    plt.legend()
+    plt.show()
+
+def build_parser():
+    parser = argparse.ArgumentParser()
+    parser.add_argument(
+            'reference_file', metavar='REF', type=str,\
+                    help="Output file of the reference simulation")
+    parser.add_argument(
+            'output_file', metavar='F', type=str,\
+                    help="Output file of the simulation to compare")
+    parser.add_argument(
+            '-p', '--plot', action='store_true',\
+                    help="Plots relative errors over time")
+    return parser
+
+if __name__ == "__main__":
+    parser = build_parser()
+    args = parser.parse_args()
+    (steps, errors) = compare(args.reference_file, args.output_file)
+    if args.plot:
+        plot(steps, errors)
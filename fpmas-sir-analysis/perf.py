@@ -36,6 +36,22 @@ def read_perf(data, num_proc, jobs_dir):
     # Stores <label>: [list_of_values], with a value for each rank
     for job_id_dir in jobs_dir.iterdir():
         values = {}
+        if not (job_id_dir / "perf.0.csv").exists():
+            # Single file aggregated with --perf-output raw, with one row per
+            # rank
+            with open(job_id_dir / "perf.csv") as perf_file:
+                for row in csv.DictReader(perf_file):
+                    for key in row.keys():
+                        if key == "rank":
+                            continue
+                        if key not in data:
+                            data[key] = []
+                        if key not in values:
+                            values[key] = []
+                        values[key].append(int(row[key]))
+            append_perf(data, values, num_proc)
+            continue
+
         with open(job_id_dir / ("perf.0.csv")) as perf_file:
             csv_data = csv.DictReader(perf_file)
             for label in csv_data.__next__().keys():
@@ -51,19 +67,22 @@ def read_perf(data, num_proc, jobs_dir):
                     for key in row.keys():
                         values[key].append(int(row[key]))
 
-        for key in values.keys():
-            if re.match(r".*time.*", key):
-                data[key].append((
-                        sum(values[key]) / num_proc,
-                        min(values[key]),
-                        max(values[key])
-                        ))
-            elif re.match(r".*count.*", key):
-                data[key].append((
-                        sum(values[key]),
-                        sum(values[key]),
-                        sum(values[key])
-                        ))
+        append_perf(data, values, num_proc)
+
+def append_perf(data, values, num_proc):
+    for key in values.keys():
+        if re.match(r".*time.*", key):
+            data[key].append((
+                    sum(values[key]) / num_proc,
+                    min(values[key]),
+                    max(values[key])
+                    ))
+        elif re.match(r".*count.*", key):
+            data[key].append((
+                    sum(values[key]),
+                    sum(values[key]),
+                    sum(values[key])
+                    ))
 
 
 '''
@@ -239,7 +258,7 @@ def plot(
             # Width of each bar
             bar_width = .12
             # Brief labels (not very generic)
-            mode_labels={"ghost": "G", "hard_sync": "H"}
+            mode_labels={"ghost": "G", "hard_sync": "H", "spmv": "S"}
 
             filtered_modes=[]
             for mode in k_data.keys():
@@ -0,0 +1,104 @@
+#include "autotune.h"
+#include "fpmas/communication/communication.h"
+#include <algorithm>
+#include <sstream>
+
+namespace macropop {
+
+	std::string TuningConfig::label() const {
+		std::string label;
+		switch(lb_method) {
+			case ZOLTAN:
+				label = "zoltan";
+				break;
+			case RANDOM:
+				label = "random";
+				break;
+		}
+		if(batch_acquire)
+			label += "+batch";
+		return label;
+	}
+
+	Autotuner::Autotuner(
+			fpmas::api::model::Model& model, LbMethods& lb_methods,
+			SyncMode sync_mode, bool tune_batch_acquire)
+		: model(model), lb_methods(lb_methods) {
+			for(LbMethod lb_method : {ZOLTAN, RANDOM}) {
+				// Batched acquisition relies on HARD_SYNC semantics
+				if(tune_batch_acquire && sync_mode == HARD_SYNC) {
+					candidates.push_back({lb_method, false});
+					candidates.push_back({lb_method, true});
+				} else {
+					candidates.push_back({lb_method, City::batch_acquire});
+				}
+			}
+		}
+
+	void Autotuner::apply(const TuningConfig& config) {
+		auto partition = lb_methods.loadBalancing(config.lb_method).balance(
+				model.graph().getLocationManager().getLocalNodes());
+		model.graph().distribute(partition);
+		City::topology_version++;
+
+		City::batch_acquire = config.batch_acquire;
+	}
+
+	void Autotuner::calibrate(
+			std::function<fpmas::scheduler::TimeStep(fpmas::scheduler::TimeStep)> run_steps,
+			fpmas::scheduler::TimeStep window) {
+		fpmas::utils::perf::Monitor monitor;
+		timings.clear();
+		windows.clear();
+		for(auto& candidate : candidates) {
+			apply(candidate);
+
+			fpmas::utils::perf::Probe calibration_probe {candidate.label()};
+			calibration_probe.start();
+			fpmas::scheduler::TimeStep steps = run_steps(window);
+			calibration_probe.stop();
+			monitor.commit(calibration_probe);
+			if(steps == 0)
+				// The simulation is over
+				break;
+
+			double local_time = std::chrono::duration_cast<std::chrono::duration<double, std::milli>>(
+					monitor.totalDuration(candidate.label())).count() / steps;
+			// The slowest process determines the step time
+			fpmas::communication::TypedMpi<double> mpi(model.getMpiCommunicator());
+			std::vector<double> times = mpi.allGather(local_time);
+			timings.push_back(*std::max_element(times.begin(), times.end()));
+
+			fpmas::scheduler::TimeStep last = static_cast<fpmas::scheduler::TimeStep>(
+					model.runtime().currentDate());
+			windows.push_back({last - steps + 1, last});
+		}
+
+		if(timings.empty())
+			return;
+
+		best = 0;
+		for(std::size_t i = 1; i < timings.size(); i++)
+			if(timings[i] < timings[best])
+				best = i;
+		// The last evaluated candidate is still applied
+		if(best != timings.size()-1)
+			apply(candidates[best]);
+
+		FPMAS_LOGI(model.getMpiCommunicator().getRank(),
+				"AUTOTUNE", "Selected configuration: %s", report().c_str());
+	}
+
+	std::string Autotuner::report() const {
+		if(timings.empty())
+			return "";
+
+		std::ostringstream report;
+		for(std::size_t i = 0; i < timings.size(); i++)
+			report << candidates[i].label()
+				<< "[" << windows[i].first << "-" << windows[i].second << "]:"
+				<< timings[i] << ";";
+		report << "->" << candidates[best].label();
+		return report.str();
+	}
+}
@@ -0,0 +1,96 @@
+#ifndef MACROPOP_AUTOTUNE_H
+#define MACROPOP_AUTOTUNE_H
+
+#include "macropop.h"
+
+namespace macropop {
+
+	/**
+	 * Configuration evaluated by the Autotuner.
+	 */
+	struct TuningConfig {
+		LbMethod lb_method;
+		bool batch_acquire;
+
+		/**
+		 * Short description of the configuration, e.g. "zoltan+batch".
+		 */
+		std::string label() const;
+	};
+
+	/**
+	 * Runtime auto-tuning of the simulation configuration.
+	 *
+	 * Each candidate configuration is applied to the already built graph,
+	 * and a calibration window of a few time steps is run with it. Once all
+	 * candidates have been evaluated, the configuration with the lowest
+	 * per-step time (maximum across processes) is applied, and the
+	 * simulation continues with it. Calibration steps are regular steps of
+	 * the simulation: no work is wasted.
+	 *
+	 * The synchronization mode is a template parameter of the graph, so it
+	 * can't be changed once the graph is built. Candidates are all
+	 * combinations of load-balancing methods and, in HARD_SYNC mode, of
+	 * batched acquisition when it has an effect on the execution.
+	 *
+	 * Candidates are evaluated on successive windows, i.e. on different
+	 * phases of the epidemic: timings include load changes between windows,
+	 * not only the effect of each configuration.
+	 */
+	class Autotuner {
+		private:
+			fpmas::api::model::Model& model;
+			LbMethods& lb_methods;
+
+			std::vector<TuningConfig> candidates;
+			/**
+			 * Per-step time of each candidate, in milliseconds.
+			 */
+			std::vector<double> timings;
+			/**
+			 * First and last time steps of the window of each candidate.
+			 */
+			std::vector<std::pair<fpmas::scheduler::TimeStep, fpmas::scheduler::TimeStep>>
+				windows;
+			std::size_t best = 0;
+
+			void apply(const TuningConfig& config);
+
+		public:
+			/**
+			 * @param model model to tune
+			 * @param lb_methods load balancing algorithms of `model`, so
+			 * that each candidate uses the algorithm selected by the
+			 * corresponding `--lb-method`
+			 * @param sync_mode synchronization mode of the model
+			 * @param tune_batch_acquire if false, batched acquisition is
+			 * not tuned and keeps its current value (e.g. if it has no
+			 * effect with the selected engine or with region aggregation)
+			 */
+			Autotuner(
+					fpmas::api::model::Model& model, LbMethods& lb_methods,
+					SyncMode sync_mode, bool tune_batch_acquire);
+
+			/**
+			 * Runs a calibration window with each candidate configuration,
+			 * and applies the fastest one.
+			 *
+			 * @param run_steps callback that runs the given count of time
+			 * steps, and returns the count of steps actually run (that can be
+			 * lower, for example if the simulation is over)
+			 * @param window count of time steps run with each candidate
+			 */
+			void calibrate(
+					std::function<fpmas::scheduler::TimeStep(fpmas::scheduler::TimeStep)> run_steps,
+					fpmas::scheduler::TimeStep window);
+
+			/**
+			 * Calibration timings and chosen configuration, formatted as
+			 * "<label>[<first step>-<last step>]:<ms per step>;...;-><chosen
+			 * label>". Windows are reported since timings of different
+			 * windows are biased by the evolution of the epidemic.
+			 */
+			std::string report() const;
+	};
+}
+#endif
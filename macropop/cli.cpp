@@ -80,5 +80,120 @@ namespace macropop {
 				std::exit(EXIT_FAILURE);
 			}
 		}
+		if(autotune_arg->count > 0)
+			autotune = true;
+		if(autotune_steps_arg->count > 0)
+			autotune_steps = autotune_steps_arg->ival[0];
+		if(rank_remap_arg->count > 0) {
+			std::string remap_str(rank_remap_arg->sval[0]);
+			if(remap_str == "none" || remap_str == "NONE")
+				rank_remap = NO_REMAP;
+			else if (remap_str == "dist_graph" || remap_str == "DIST_GRAPH")
+				rank_remap = DIST_GRAPH;
+			else if (remap_str == "greedy" || remap_str == "GREEDY")
+				rank_remap = NODE_GREEDY;
+			else {
+				std::cout << "Unknown rank remapping: " << remap_str << std::endl;
+				printf("Try 'fpmas-sir-macropop --help' for more information.\n");
+
+				arg_freetable(argtable, sizeof(argtable) / sizeof(argtable[0]));
+				std::exit(EXIT_FAILURE);
+			}
+		}
+		if(engine_arg->count > 0) {
+			std::string engine_str(engine_arg->sval[0]);
+			if(engine_str == "agent" || engine_str == "AGENT")
+				engine = AGENT;
+			else if (engine_str == "spmv" || engine_str == "SPMV")
+				engine = SPMV;
+			else {
+				std::cout << "Unknown engine: " << engine_str << std::endl;
+				printf("Try 'fpmas-sir-macropop --help' for more information.\n");
+
+				arg_freetable(argtable, sizeof(argtable) / sizeof(argtable[0]));
+				std::exit(EXIT_FAILURE);
+			}
+		}
+		if(migration_period_arg->count > 0)
+			migration_period = migration_period_arg->ival[0];
+		if(disease_period_arg->count > 0)
+			disease_period = disease_period_arg->ival[0];
+		if(migration_period < 1 || disease_period < 1) {
+			std::cout << "Migration and disease periods must be positive" << std::endl;
+			printf("Try 'fpmas-sir-macropop --help' for more information.\n");
+
+			arg_freetable(argtable, sizeof(argtable) / sizeof(argtable[0]));
+			std::exit(EXIT_FAILURE);
+		}
+		if(splitting_arg->count > 0) {
+			std::string splitting_str(splitting_arg->sval[0]);
+			if(splitting_str == "lie" || splitting_str == "LIE")
+				splitting = LIE;
+			else if (splitting_str == "strang" || splitting_str == "STRANG")
+				splitting = STRANG;
+			else {
+				std::cout << "Unknown splitting: " << splitting_str << std::endl;
+				printf("Try 'fpmas-sir-macropop --help' for more information.\n");
+
+				arg_freetable(argtable, sizeof(argtable) / sizeof(argtable[0]));
+				std::exit(EXIT_FAILURE);
+			}
+		}
+		// Operators are applied at period / 2 with Strang splitting, that
+		// is only the middle of the period for even periods
+		if(splitting == STRANG && (
+					(migration_period > 1 && migration_period % 2 != 0)
+					|| (disease_period > 1 && disease_period % 2 != 0))) {
+			std::cout << "Migration and disease periods must be 1 or even with Strang splitting" << std::endl;
+			printf("Try 'fpmas-sir-macropop --help' for more information.\n");
+
+			arg_freetable(argtable, sizeof(argtable) / sizeof(argtable[0]));
+			std::exit(EXIT_FAILURE);
+		}
+		if(batch_acquire_arg->count > 0)
+			batch_acquire = true;
+		if(region_aggregation_arg->count > 0)
+			region_aggregation = true;
+		if(perf_output_arg->count > 0) {
+			std::string perf_output_str(perf_output_arg->sval[0]);
+			if(perf_output_str == "per_rank" || perf_output_str == "PER_RANK")
+				perf_output = PER_RANK;
+			else if (perf_output_str == "raw" || perf_output_str == "RAW")
+				perf_output = AGGREGATED_RAW;
+			else if (perf_output_str == "stats" || perf_output_str == "STATS")
+				perf_output = AGGREGATED_STATS;
+			else {
+				std::cout << "Unknown perf output mode: " << perf_output_str << std::endl;
+				printf("Try 'fpmas-sir-macropop --help' for more information.\n");
+
+				arg_freetable(argtable, sizeof(argtable) / sizeof(argtable[0]));
+				std::exit(EXIT_FAILURE);
+			}
+		}
+		if(mem_period_arg->count > 0)
+			mem_period = mem_period_arg->ival[0];
+		if(mem_period < 0) {
+			std::cout << "Memory output period must be positive or null" << std::endl;
+			printf("Try 'fpmas-sir-macropop --help' for more information.\n");
+
+			arg_freetable(argtable, sizeof(argtable) / sizeof(argtable[0]));
+			std::exit(EXIT_FAILURE);
+		}
+		if(activity_threshold_arg->count > 0)
+			activity_threshold = activity_threshold_arg->dval[0];
+		if(extinction_epsilon_arg->count > 0)
+			extinction_epsilon = extinction_epsilon_arg->dval[0];
+		// Sleeping cities keep less than activity_threshold infected people,
+		// that are not integrated anymore: the global infected population
+		// can stay up to city_count * activity_threshold
+		if(extinction_epsilon > 0 && activity_threshold > 0
+				&& extinction_epsilon < city_count * activity_threshold) {
+			std::cout << "Extinction epsilon must be at least city count * activity threshold, "
+				"or the extinction might never be detected" << std::endl;
+			printf("Try 'fpmas-sir-macropop --help' for more information.\n");
+
+			arg_freetable(argtable, sizeof(argtable) / sizeof(argtable[0]));
+			std::exit(EXIT_FAILURE);
+		}
 	}
 }
@@ -29,9 +29,35 @@ namespace macropop {
 				= arg_strn("S", "sync-mode", "<sync-mode>", 0, 1, "Synchronization mode: 'ghost' or 'hard_sync' (default: hard_sync)");
 			struct arg_str* lb_method_arg
 				= arg_strn("l", "lb-method", "<lb-method>", 0, 1, "Load-balancing method: 'zoltan' or 'random' (default: zoltan)");
+			struct arg_lit* autotune_arg
+				= arg_litn(NULL, "autotune", 0, 1, "Evaluates each applicable load-balancing method and batched acquisition mode on a few time steps, and continues with the fastest one");
+			struct arg_int* autotune_steps_arg
+				= arg_intn(NULL, "autotune-steps", "<n>", 0, 1, "Count of time steps run with each configuration evaluated by --autotune (default: 5)");
+			struct arg_str* rank_remap_arg
+				= arg_strn(NULL, "rank-remap", "<remap>", 0, 1, "Topology-aware remapping of partitions to processes after load balancing: 'none', 'dist_graph' or 'greedy' (default: none)");
+			struct arg_str* engine_arg
+				= arg_strn("e", "engine", "<engine>", 0, 1, "Execution engine: 'agent' or 'spmv' (default: agent)");
+			struct arg_int* migration_period_arg
+				= arg_intn(NULL, "migration-period", "<n>", 0, 1, "Count of time steps between two migration steps. Must be 1 or even with Strang splitting. A last partial period before --max-step is not integrated, so up to <n>-1 steps are missing from the total migration time (default: 1)");
+			struct arg_int* disease_period_arg
+				= arg_intn(NULL, "disease-period", "<n>", 0, 1, "Count of time steps between two disease updates, each performing <n> integration substeps. Must be 1 or even with Strang splitting. A last partial period before --max-step is not integrated, so up to <n>-1 steps are missing from the total integrated time (default: 1)");
+			struct arg_str* splitting_arg
+				= arg_strn(NULL, "splitting", "<splitting>", 0, 1, "Operator splitting of multi-rate steps: 'lie' or 'strang', that requires periods of 1 or even periods (default: lie)");
+			struct arg_lit* batch_acquire_arg
+				= arg_litn(NULL, "batch-acquire", 0, 1, "In hard_sync mode, exchanges migrations to distant cities in a single batch at the end of each step");
+			struct arg_lit* region_aggregation_arg
+				= arg_litn(NULL, "region-aggregation", 0, 1, "In hard_sync mode with the agent engine, aggregates migrations between processes into a single flow per pair of regions, split across target cities according to edge weights (approximate)");
+			struct arg_str* perf_output_arg
+				= arg_strn(NULL, "perf-output", "<mode>", 0, 1, "Performance and load balancing outputs: 'per_rank' (perf.%r.csv and lb.%r.csv), 'raw' (all rows in perf.csv and lb.csv) or 'stats' (min/mean/max/percentiles in perf.csv and lb.csv) (default: per_rank)");
+			struct arg_int* mem_period_arg
+				= arg_intn(NULL, "mem-period", "<n>", 0, 1, "Period, in time steps, of the memory output (default: 0, only at the end of the simulation)");
+			struct arg_dbl* activity_threshold_arg
+				= arg_dbln(NULL, "activity-threshold", "<f>", 0, 1, "Cities whose population change and infected count fall below this threshold are skipped until infected people migrate to them (default: 0, disabled)");
+			struct arg_dbl* extinction_epsilon_arg
+				= arg_dbln(NULL, "extinction-epsilon", "<f>", 0, 1, "Stops the simulation once the global infected population falls below this value. Must be at least city count * activity threshold when activity tracking is enabled (default: 0, disabled)");
 			struct arg_end* end = arg_end(20);
 
-			void* argtable[13] = {
+			void* argtable[26] = {
 				help,
 				city_count_arg,
 				population_arg,
@@ -44,6 +70,19 @@ namespace macropop {
 				max_step_arg,
 				sync_mode_arg,
 				lb_method_arg,
+				autotune_arg,
+				autotune_steps_arg,
+				rank_remap_arg,
+				engine_arg,
+				migration_period_arg,
+				disease_period_arg,
+				splitting_arg,
+				batch_acquire_arg,
+				region_aggregation_arg,
+				perf_output_arg,
+				mem_period_arg,
+				activity_threshold_arg,
+				extinction_epsilon_arg,
 				end
 			};
 
@@ -61,6 +100,19 @@ namespace macropop {
 			int max_step = 1000;
 			SyncMode sync_mode = HARD_SYNC;
 			LbMethod lb_method = ZOLTAN;
+			bool autotune = false;
+			int autotune_steps = 5;
+			RemapMethod rank_remap = NO_REMAP;
+			Engine engine = AGENT;
+			int migration_period = 1;
+			int disease_period = 1;
+			Splitting splitting = LIE;
+			bool batch_acquire = false;
+			bool region_aggregation = false;
+			PerfOutputMode perf_output = PER_RANK;
+			int mem_period = 0;
+			double activity_threshold = 0;
+			double extinction_epsilon = 0;
 
 			Config(int argc, char** argv);
 
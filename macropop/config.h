@@ -16,5 +16,27 @@ namespace macropop {
 		ZOLTAN,
 		RANDOM
 	};
+
+	enum RemapMethod {
+		NO_REMAP,
+		DIST_GRAPH,
+		NODE_GREEDY
+	};
+
+	enum Splitting {
+		LIE,
+		STRANG
+	};
+
+	enum PerfOutputMode {
+		PER_RANK,
+		AGGREGATED_RAW,
+		AGGREGATED_STATS
+	};
+
+	enum Engine {
+		AGENT,
+		SPMV
+	};
 }
 #endif
@@ -0,0 +1,71 @@
+#include "log.h"
+#include <cstdlib>
+
+namespace macropop { namespace log {
+
+	static std::size_t next_power_of_two(std::size_t n) {
+		std::size_t power = 1;
+		while(power < n)
+			power <<= 1;
+		return power;
+	}
+
+	RingBuffer::RingBuffer(std::size_t capacity)
+		: records(next_power_of_two(capacity)), mask(records.size()-1) {
+		}
+
+	Logger& Logger::instance() {
+		static Logger logger;
+		return logger;
+	}
+
+	void Logger::init(int rank, std::string file_format) {
+		this->rank = rank;
+		std::size_t index = file_format.find("%r");
+		if(index != std::string::npos)
+			file_format.replace(index, 2, std::to_string(rank));
+		this->file_name = file_format;
+
+		std::atexit([] () {instance().flush();});
+	}
+
+	void Logger::flush() {
+		static const char* level_labels[] = {"DEBUG", "INFO", "WARN", "ERROR"};
+
+		Record record;
+		std::size_t dropped = buffer.dropped();
+		bool empty = !buffer.pop(record);
+		if(empty && dropped == 0)
+			return;
+		if(file == nullptr) {
+			if(file_name.empty())
+				file = stderr;
+			else
+				file = std::fopen(file_name.c_str(), "w");
+			if(file == nullptr)
+				return;
+		}
+		if(dropped > 0)
+			std::fprintf(file, "[%i][WARN][LOG] %zu records dropped (buffer full)\n",
+					rank, dropped);
+		if(empty) {
+			std::fflush(file);
+			return;
+		}
+		do {
+			char message[256];
+			// Unused arguments are ignored by snprintf
+			std::snprintf(message, sizeof(message), record.format,
+					record.args[0], record.args[1], record.args[2], record.args[3]);
+			std::fprintf(file, "[%lld][%i][%s][%s] %s\n",
+					(long long) record.time, rank,
+					level_labels[record.level], record.tag, message);
+		} while(buffer.pop(record));
+		std::fflush(file);
+	}
+
+	Logger::~Logger() {
+		if(file != nullptr && file != stderr)
+			std::fclose(file);
+	}
+}}
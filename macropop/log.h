@@ -0,0 +1,242 @@
+#ifndef MACROPOP_LOG_H
+#define MACROPOP_LOG_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <tuple>
+#include <vector>
+
+#define MACROPOP_LOG_LEVEL_DEBUG 0
+#define MACROPOP_LOG_LEVEL_INFO 1
+#define MACROPOP_LOG_LEVEL_WARN 2
+#define MACROPOP_LOG_LEVEL_ERROR 3
+#define MACROPOP_LOG_LEVEL_NONE 4
+
+/*
+ * Minimum level of log messages compiled in the binary. Call sites of
+ * lower levels are removed by the preprocessor, so that their arguments are
+ * not even evaluated.
+ */
+#ifndef MACROPOP_LOG_LEVEL
+#define MACROPOP_LOG_LEVEL MACROPOP_LOG_LEVEL_WARN
+#endif
+
+/*
+ * Formats are checked at compile time: arguments are stored as double, so
+ * only floating point conversions (%f, %e, %g and %a, with optional flags,
+ * width and precision) are allowed, one per argument.
+ */
+#define MACROPOP_LOG(level, tag, format, ...) \
+	do { \
+		static_assert(macropop::log::format_arg_count(format) \
+				== std::tuple_size<decltype(std::make_tuple(__VA_ARGS__))>::value, \
+				"Log formats only allow one floating point conversion per argument"); \
+		macropop::log::Logger::instance().log(level, tag, format, ##__VA_ARGS__); \
+	} while(0)
+
+#if MACROPOP_LOG_LEVEL <= MACROPOP_LOG_LEVEL_DEBUG
+#define MACROPOP_LOGD(tag, format, ...) \
+	MACROPOP_LOG(macropop::log::DEBUG, tag, format, ##__VA_ARGS__)
+#else
+#define MACROPOP_LOGD(tag, format, ...)
+#endif
+
+#if MACROPOP_LOG_LEVEL <= MACROPOP_LOG_LEVEL_INFO
+#define MACROPOP_LOGI(tag, format, ...) \
+	MACROPOP_LOG(macropop::log::INFO, tag, format, ##__VA_ARGS__)
+#else
+#define MACROPOP_LOGI(tag, format, ...)
+#endif
+
+#if MACROPOP_LOG_LEVEL <= MACROPOP_LOG_LEVEL_WARN
+#define MACROPOP_LOGW(tag, format, ...) \
+	MACROPOP_LOG(macropop::log::WARN, tag, format, ##__VA_ARGS__)
+#else
+#define MACROPOP_LOGW(tag, format, ...)
+#endif
+
+#if MACROPOP_LOG_LEVEL <= MACROPOP_LOG_LEVEL_ERROR
+#define MACROPOP_LOGE(tag, format, ...) \
+	MACROPOP_LOG(macropop::log::ERROR, tag, format, ##__VA_ARGS__)
+#else
+#define MACROPOP_LOGE(tag, format, ...)
+#endif
+
+namespace macropop { namespace log {
+	enum Level {
+		DEBUG = MACROPOP_LOG_LEVEL_DEBUG,
+		INFO = MACROPOP_LOG_LEVEL_INFO,
+		WARN = MACROPOP_LOG_LEVEL_WARN,
+		ERROR = MACROPOP_LOG_LEVEL_ERROR
+	};
+
+	/**
+	 * Returns the count of conversions in `format`, or INVALID_FORMAT if
+	 * `format` contains a conversion other than %f, %e, %g or %a (and their
+	 * upper case variants), with optional flags, width and precision.
+	 */
+	constexpr std::size_t INVALID_FORMAT = static_cast<std::size_t>(-1);
+	constexpr std::size_t format_arg_count(const char* format) {
+		std::size_t count = 0;
+		for(std::size_t i = 0; format[i] != '\0'; i++) {
+			if(format[i] != '%')
+				continue;
+			i++;
+			if(format[i] == '%')
+				continue;
+			while(format[i] == '-' || format[i] == '+' || format[i] == ' '
+					|| format[i] == '#' || format[i] == '.'
+					|| (format[i] >= '0' && format[i] <= '9'))
+				i++;
+			switch(format[i]) {
+				case 'f': case 'F':
+				case 'e': case 'E':
+				case 'g': case 'G':
+				case 'a': case 'A':
+					count++;
+					break;
+				default:
+					return INVALID_FORMAT;
+			}
+		}
+		return count;
+	}
+
+	/**
+	 * Binary log record.
+	 *
+	 * Tags and formats must be string literals: only pointers are stored,
+	 * and messages are only formatted when records are flushed.
+	 */
+	struct Record {
+		static const std::size_t MAX_ARGS = 4;
+
+		std::chrono::steady_clock::rep time;
+		Level level;
+		const char* tag;
+		const char* format;
+		double args[MAX_ARGS];
+	};
+
+	/**
+	 * Lock-free single producer / single consumer ring buffer of log
+	 * records.
+	 *
+	 * When the buffer is full, new records are dropped rather than blocking
+	 * the producer.
+	 */
+	class RingBuffer {
+		private:
+			std::vector<Record> records;
+			std::size_t mask;
+			std::atomic<std::size_t> head {0};
+			std::atomic<std::size_t> tail {0};
+			std::atomic<std::size_t> _dropped {0};
+
+		public:
+			/**
+			 * @param capacity buffer capacity, rounded up to a power of two
+			 */
+			RingBuffer(std::size_t capacity);
+
+			/**
+			 * Pushes a record in the buffer, or drops it if the buffer is
+			 * full.
+			 */
+			void push(const Record& record) {
+				std::size_t h = head.load(std::memory_order_relaxed);
+				if(h - tail.load(std::memory_order_acquire) > mask) {
+					_dropped.fetch_add(1, std::memory_order_relaxed);
+					return;
+				}
+				records[h & mask] = record;
+				head.store(h+1, std::memory_order_release);
+			}
+
+			/**
+			 * Pops a record from the buffer.
+			 *
+			 * @return false iff the buffer is empty
+			 */
+			bool pop(Record& record) {
+				std::size_t t = tail.load(std::memory_order_relaxed);
+				if(t == head.load(std::memory_order_acquire))
+					return false;
+				record = records[t & mask];
+				tail.store(t+1, std::memory_order_release);
+				return true;
+			}
+
+			/**
+			 * Count of records dropped since the last call, because the
+			 * buffer was full.
+			 */
+			std::size_t dropped() {
+				return _dropped.exchange(0, std::memory_order_relaxed);
+			}
+	};
+
+	/**
+	 * Per process logger.
+	 *
+	 * Enabled log calls only store a binary Record in a RingBuffer. Records
+	 * are formatted and written to the log file of the current process by
+	 * flush(), that must be called out of the hot path (e.g. at the end of
+	 * each time step) and is also called on exit.
+	 *
+	 * Records are not flushed on crash signals, since formatting and
+	 * writing them is not async-signal-safe: at most the records logged
+	 * since the last periodic flush are lost.
+	 */
+	class Logger {
+		private:
+			RingBuffer buffer {1 << 16};
+			int rank = 0;
+			std::string file_name;
+			std::FILE* file = nullptr;
+
+			Logger() = default;
+
+		public:
+			Logger(const Logger&) = delete;
+			Logger& operator=(const Logger&) = delete;
+			~Logger();
+
+			static Logger& instance();
+
+			/**
+			 * Initializes the logger of the current process.
+			 *
+			 * @param rank rank of the current process, reported in each
+			 * message
+			 * @param file_format log file name, where "%r" is replaced by
+			 * `rank`
+			 */
+			void init(int rank, std::string file_format);
+
+			/**
+			 * Stores a log record. Arguments must be convertible to double,
+			 * and `format` must only contain floating point conversions:
+			 * use the MACROPOP_LOG* macros, that check it at compile time.
+			 */
+			template<typename... Args>
+				void log(Level level, const char* tag, const char* format, Args... args) {
+					static_assert(sizeof...(Args) <= Record::MAX_ARGS,
+							"Too many log arguments");
+					Record record {
+						std::chrono::steady_clock::now().time_since_epoch().count(),
+						level, tag, format, {static_cast<double>(args)...}
+					};
+					buffer.push(record);
+				}
+
+			/**
+			 * Formats and writes all buffered records to the log file.
+			 */
+			void flush();
+	};
+}}
+#endif
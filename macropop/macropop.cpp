@@ -1,5 +1,10 @@
 #include "macropop.h"
+#include "log.h"
 #include "fpmas/model/guards.h"
+#include "fpmas/communication/communication.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
 
 namespace macropop {
 
@@ -34,20 +39,219 @@ namespace macropop {
 		population.R = j.at("R").get<double>();
 	}
 
+	MPI_Comm mpi_comm(fpmas::api::communication::MpiCommunicator& comm) {
+		return dynamic_cast<fpmas::communication::MpiCommunicatorBase&>(comm)
+			.getMpiComm();
+	}
+
 	fpmas::utils::perf::Monitor City::monitor;
 	std::string City::BEHAVIOR_PROBE = "city_behavior";
 	std::string City::COMM_PROBE = "city_comm";
 	std::string City::DISTANT_COMM_PROBE = "city_distant_comm";
 	std::string City::SYNC_PROBE = "sync";
+	std::string City::OVERLAP_PROBE = "overlap";
+	std::string City::HALO_WAIT_PROBE = "halo_wait";
 	fpmas::utils::perf::Probe City::behavior_probe {BEHAVIOR_PROBE};
 	fpmas::utils::perf::Probe City::comm_probe {COMM_PROBE};
 	fpmas::utils::perf::Probe City::sync_probe {SYNC_PROBE};
+	double City::activity_threshold = 0;
+	bool City::batch_acquire = false;
+	bool City::region_aggregation = false;
+	MigrationBatch City::migration_batch;
+	Pool<City> City::pool;
+	std::size_t City::topology_version = 0;
+	int City::migration_period = 1;
+
+	double City::period_rate(double g) {
+		return 1 - std::pow(1 - g, migration_period);
+	}
+	const std::size_t NeighborCache::INVALID = std::numeric_limits<std::size_t>::max();
+
+	void* City::operator new(std::size_t size) {
+		// Classes derived from City can't be allocated in the pool
+		if(size != sizeof(City))
+			return ::operator new(size);
+		return pool.allocate();
+	}
+
+	void City::operator delete(void* ptr, std::size_t size) {
+		if(size != sizeof(City))
+			::operator delete(ptr);
+		else
+			pool.deallocate(ptr);
+	}
+
+	MigrationBatch::MigrationBatch()
+		: plan_version(NeighborCache::INVALID),
+		overlap_probe(City::OVERLAP_PROBE), halo_wait_probe(City::HALO_WAIT_PROBE) {
+		}
+
+	/**
+	 * Builds send slots of distant cities targeted by local cities, and
+	 * sends the weight of each CITY_TO_CITY edge to a distant city to the
+	 * owner of the target city, so that each process knows which local
+	 * cities receive each slot (and how to split flows received from other
+	 * regions).
+	 */
+	void MigrationBatch::build_plan(fpmas::api::model::AgentGraph& graph) {
+		if(comm == MPI_COMM_NULL)
+			MPI_Comm_dup(mpi_comm(graph.getMpiCommunicator()), &comm);
+
+		std::unordered_map<
+			int, std::map<fpmas::api::graph::DistributedId, double>
+			> edge_weights;
+		boundary_cities = 0;
+		for(auto node : graph.getLocationManager().getLocalNodes()) {
+			if(dynamic_cast<City*>(node.second->data().get()) == nullptr)
+				continue;
+			auto edges = node.second->getOutgoingEdges(CITY_TO_CITY);
+			// The same population amount is sent to each neighbor
+			double m = 1. / edges.size();
+			bool boundary = false;
+			for(auto edge : edges) {
+				auto target = edge->getTargetNode();
+				if(target->state() == fpmas::api::graph::DISTANT) {
+					edge_weights[target->location()][target->getId()] += m;
+					boundary = true;
+				}
+			}
+			if(boundary)
+				boundary_cities++;
+		}
+
+		send_slots.clear();
+		send_ranks.clear();
+		send_counts.clear();
+		send_displs.clear();
+		std::size_t slot = 0;
+		for(auto& rank_weights : std::map<
+				int, std::map<fpmas::api::graph::DistributedId, double>
+				>(edge_weights.begin(), edge_weights.end())) {
+			send_ranks.push_back(rank_weights.first);
+			send_displs.push_back(slot);
+			for(auto& weight : rank_weights.second) {
+				send_slots[weight.first] = slot;
+				if(!City::region_aggregation)
+					slot++;
+			}
+			if(City::region_aggregation)
+				slot++;
+			send_counts.push_back(slot - send_displs.back());
+		}
+		send_buffer.assign(3*slot, 0);
+
+		fpmas::communication::TypedMpi<
+			std::map<fpmas::api::graph::DistributedId, double>
+			> mpi(graph.getMpiCommunicator());
+		auto received = mpi.allToAll(std::move(edge_weights));
+
+		recv_ranks.clear();
+		recv_counts.clear();
+		recv_displs.clear();
+		recv_cities.clear();
+		slot = 0;
+		for(auto& rank_weights : std::map<
+				int, std::map<fpmas::api::graph::DistributedId, double>
+				>(received.begin(), received.end())) {
+			if(rank_weights.second.empty())
+				continue;
+			recv_ranks.push_back(rank_weights.first);
+			recv_displs.push_back(slot);
+			if(City::region_aggregation) {
+				double total = 0;
+				for(auto& weight : rank_weights.second)
+					total += weight.second;
+				recv_cities.emplace_back();
+				for(auto& weight : rank_weights.second)
+					recv_cities.back().push_back({
+							dynamic_cast<City*>(graph.getNode(weight.first)->data().get()),
+							weight.second / total
+							});
+			} else {
+				for(auto& weight : rank_weights.second)
+					recv_cities.push_back({{
+							dynamic_cast<City*>(graph.getNode(weight.first)->data().get()),
+							1.
+							}});
+			}
+			slot = recv_cities.size();
+			recv_counts.push_back(slot - recv_displs.back());
+		}
+		recv_buffer.assign(3*slot, 0);
+
+		plan_version = City::topology_version;
+	}
+
+	void MigrationBatch::begin(fpmas::api::model::AgentGraph& graph) {
+		// topology_version is updated by all processes at the same time, so
+		// all processes take part in the collective rebuild
+		if(plan_version != City::topology_version)
+			build_plan(graph);
+
+		started = false;
+		pending_boundary_cities = boundary_cities;
+		if(pending_boundary_cities == 0)
+			start();
+	}
+
+	void MigrationBatch::add(City* city, const Population& migration) {
+		std::size_t slot = send_slots.at(city->node()->getId());
+		send_buffer[3*slot] += migration.S;
+		send_buffer[3*slot+1] += migration.I;
+		send_buffer[3*slot+2] += migration.R;
+	}
+
+	void MigrationBatch::boundaryCityDone() {
+		if(pending_boundary_cities > 0 && --pending_boundary_cities == 0)
+			start();
+	}
+
+	void MigrationBatch::start() {
+		requests.clear();
+		for(std::size_t i = 0; i < recv_ranks.size(); i++) {
+			requests.emplace_back();
+			MPI_Irecv(
+					&recv_buffer[3*recv_displs[i]], 3*recv_counts[i], MPI_DOUBLE,
+					recv_ranks[i], 0, comm, &requests.back());
+		}
+		for(std::size_t i = 0; i < send_ranks.size(); i++) {
+			requests.emplace_back();
+			MPI_Isend(
+					&send_buffer[3*send_displs[i]], 3*send_counts[i], MPI_DOUBLE,
+					send_ranks[i], 0, comm, &requests.back());
+		}
+		started = true;
+		overlap_probe.start();
+	}
+
+	void MigrationBatch::finish() {
+		if(!started)
+			// Only if some boundary cities were not executed
+			start();
+		overlap_probe.stop();
+
+		halo_wait_probe.start();
+		MPI_Waitall(requests.size(), requests.data(), MPI_STATUSES_IGNORE);
+		halo_wait_probe.stop();
+
+		// Processes are synchronized, so local cities can be safely updated
+		for(std::size_t j = 0; j < recv_cities.size(); j++) {
+			Population migration(
+					recv_buffer[3*j], recv_buffer[3*j+1], recv_buffer[3*j+2]);
+			for(auto& city : recv_cities[j])
+				city.first->receive(city.second * migration);
+		}
+		std::fill(send_buffer.begin(), send_buffer.end(), 0.);
+
+		City::monitor.commit(overlap_probe);
+		City::monitor.commit(halo_wait_probe);
+	}
 
 	/**
 	 * Migrate population from this city to the neighbor city, according to the
 	 * city migration rates.
 	 */
-	void City::migrate(double m, City* neighbor_city) {
+	void City::migrate(const Population& rates, City* neighbor_city) {
 		// This probe is initialized at each migrate call, depending on the
 		// input `neighbor_city`
 		fpmas::utils::perf::Probe distant_comm_probe {
@@ -67,9 +271,9 @@ namespace macropop {
 
 			// Computes migration
 			migration = {
-				g_s * m * this->population.S,
-				g_i * m * this->population.I,
-				g_r * m * this->population.R
+				rates.S * this->population.S,
+				rates.I * this->population.I,
+				rates.R * this->population.R
 			};
 			// Removes population from this city while its lock
 			this->population -= migration;
@@ -80,6 +284,15 @@ namespace macropop {
 		}
 		this->comm_probe.stop();
 
+		if((batch_acquire || region_aggregation)
+				&& neighbor_city->node()->state() == fpmas::api::graph::DISTANT) {
+			// The migration will be applied by the owner of `neighbor_city`
+			// when the batch is finished, at the end of the step
+			migration_batch.add(neighbor_city, migration);
+			City::monitor.commit(this->comm_probe);
+			return;
+		}
+
 		{
 			// Then, acquires the target city
 			this->comm_probe.start();
@@ -89,7 +302,7 @@ namespace macropop {
 			this->comm_probe.stop();
 
 			// Safely add population to the target city
-			neighbor_city->population += migration;
+			neighbor_city->receive(migration);
 
 			// End of `acquire` scope : automatically releases and commits write
 			// operations on `neighbor_city`
@@ -104,26 +317,91 @@ namespace macropop {
 		City::monitor.commit(distant_comm_probe);
 	}
 
+	void City::receive(const Population& migration) {
+		this->population += migration;
+		if(!this->active) {
+			Population delta = this->population;
+			delta -= this->last_population;
+			double change = std::max({
+					std::abs(delta.S), std::abs(delta.I), std::abs(delta.R)
+					});
+			// Wakes up the city once accumulated inflows have moved its
+			// population away from its quiescent state, or once infected
+			// people have built up in it
+			if(change >= activity_threshold
+					|| this->population.I >= activity_threshold)
+				this->active = true;
+		}
+	}
+
+	/**
+	 * Returns CITY_TO_CITY out neighbors, rebuilding the cache only if the
+	 * topology has changed since the last call.
+	 */
+	const NeighborCache& City::neighbors() {
+		if(neighbor_cache.version != topology_version) {
+			neighbor_cache.nodes.clear();
+			neighbor_cache.boundary = false;
+			for(auto edge : node()->getOutgoingEdges(CITY_TO_CITY)) {
+				neighbor_cache.nodes.push_back(edge->getTargetNode());
+				if(edge->getTargetNode()->state() == fpmas::api::graph::DISTANT)
+					neighbor_cache.boundary = true;
+			}
+			// The same population amount is sent to each city
+			double m = 1. / neighbor_cache.nodes.size();
+			neighbor_cache.rates = {
+				period_rate(g_s) * m,
+				period_rate(g_i) * m,
+				period_rate(g_r) * m
+			};
+			neighbor_cache.version = topology_version;
+		}
+		return neighbor_cache;
+	}
+
 	/**
 	 * City Agent Behavior.
 	 */
 	void City::migrate_population() {
-		this->behavior_probe.start();
-
 		// Get City neighbors
-		auto neighbors = outNeighbors<City>(CITY_TO_CITY);
-		// The same population amount is sent to each city
-		double m = 1. / neighbors.count();
+		const NeighborCache& neighbors = this->neighbors();
+		bool batched = batch_acquire || region_aggregation;
+
+		// Quiescent cities are skipped until woken up by a neighbor
+		if(!this->active) {
+			if(batched && neighbors.boundary)
+				migration_batch.boundaryCityDone();
+			return;
+		}
+
+		this->behavior_probe.start();
 
 		// Migrate population to each neighbor
-		for(auto neighbor_city : neighbors) {
-			migrate(m, neighbor_city);
+		for(auto neighbor_node : neighbors.nodes) {
+			migrate(neighbors.rates, static_cast<City*>(neighbor_node->data().get()));
 		}
+		if(batched && neighbors.boundary)
+			// Distant migrations of this city are all in the batch
+			migration_batch.boundaryCityDone();
 
-		FPMAS_LOGI(this->model()->graph().getMpiCommunicator().getRank(),
-				"CITY", "Updated city population : %f",
+		MACROPOP_LOGI("CITY", "Updated city population : %f",
 				this->population.N());
 
+		if(activity_threshold > 0) {
+			fpmas::model::LockGuard lock(this);
+			Population delta = this->population;
+			delta -= this->last_population;
+			double change = std::max({
+					std::abs(delta.S), std::abs(delta.I), std::abs(delta.R)
+					});
+			// The city is put to sleep once its population is stable and
+			// (almost) free of infected people
+			if(change < activity_threshold
+					&& this->population.I < activity_threshold)
+				this->active = false;
+			this->last_population = this->population;
+		}
+
 		this->behavior_probe.stop();
 		City::monitor.commit(behavior_probe);
 	}
@@ -133,14 +411,108 @@ namespace macropop {
 		j["g_s"] = city->g_s;
 		j["g_i"] = city->g_i;
 		j["g_r"] = city->g_r;
+		if(activity_threshold > 0) {
+			// Activity tracking state, only serialized when enabled
+			j["last"] = city->last_population;
+			j["act"] = city->active;
+		}
 	}
 
 	City* City::from_json(const ::nlohmann::json& json) {
-		return new City(
+		City* city = new City(
 				json.at("pop").get<Population>(),
 				json.at("g_s").get<double>(),
 				json.at("g_i").get<double>(),
 				json.at("g_r").get<double>());
+		if(json.count("last") > 0)
+			city->last_population = json.at("last").get<Population>();
+		if(json.count("act") > 0)
+			city->active = json.at("act").get<bool>();
+		return city;
+	}
+
+	std::vector<City*> rcm_order(const std::vector<City*>& cities) {
+		std::map<fpmas::api::graph::DistributedId, std::size_t> indices;
+		for(std::size_t i = 0; i < cities.size(); i++)
+			indices[cities[i]->node()->getId()] = i;
+
+		std::vector<std::vector<std::size_t>> adjacency(cities.size());
+		for(std::size_t i = 0; i < cities.size(); i++)
+			for(auto edge : cities[i]->node()->getOutgoingEdges(CITY_TO_CITY)) {
+				auto target = edge->getTargetNode();
+				if(target->state() == fpmas::api::graph::LOCAL) {
+					std::size_t j = indices.at(target->getId());
+					adjacency[i].push_back(j);
+					adjacency[j].push_back(i);
+				}
+			}
+		auto by_degree = [&adjacency] (std::size_t i, std::size_t j) {
+			return adjacency[i].size() < adjacency[j].size();
+		};
+		for(auto& neighbors : adjacency)
+			std::sort(neighbors.begin(), neighbors.end(), by_degree);
+
+		// Starting points of each connected component are chosen by
+		// increasing degree
+		std::vector<std::size_t> starts(cities.size());
+		for(std::size_t i = 0; i < starts.size(); i++)
+			starts[i] = i;
+		std::stable_sort(starts.begin(), starts.end(), by_degree);
+
+		std::vector<bool> visited(cities.size(), false);
+		std::vector<std::size_t> order;
+		order.reserve(cities.size());
+		for(auto start : starts) {
+			if(visited[start])
+				continue;
+			visited[start] = true;
+			std::size_t next = order.size();
+			order.push_back(start);
+			// Breadth first search, using `order` as a queue
+			while(next < order.size()) {
+				for(auto neighbor : adjacency[order[next]])
+					if(!visited[neighbor]) {
+						visited[neighbor] = true;
+						order.push_back(neighbor);
+					}
+				next++;
+			}
+		}
+
+		std::vector<City*> reordered;
+		reordered.reserve(cities.size());
+		for(auto i = order.rbegin(); i != order.rend(); i++)
+			reordered.push_back(cities[*i]);
+		return reordered;
+	}
+
+	CityOrdering::CityOrdering(fpmas::api::model::AgentGroup& group)
+		: group(group), ordered_version(NeighborCache::INVALID) {
+		}
+
+	void CityOrdering::run() {
+		if(ordered_version == City::topology_version)
+			return;
+
+		std::vector<City*> cities;
+		for(auto agent : group.localAgents())
+			cities.push_back(dynamic_cast<City*>(agent));
+		cities = rcm_order(cities);
+		// Boundary cities first, so that distant migrations are in flight
+		// while interior cities are executed
+		std::stable_partition(cities.begin(), cities.end(), [] (City* city) {
+				for(auto edge : city->node()->getOutgoingEdges(CITY_TO_CITY))
+					if(edge->getTargetNode()->state() == fpmas::api::graph::DISTANT)
+						return true;
+				return false;
+				});
+
+		auto& job = group.agentExecutionJob();
+		for(auto city : cities)
+			job.remove(*city->task());
+		for(auto city : cities)
+			job.add(*city->task());
+		ordered_version = City::topology_version;
 	}
 
 	void GraphSyncProbe::run() {
@@ -148,25 +520,77 @@ namespace macropop {
 		sync_graph_task.run();
 		City::sync_probe.stop();
 		City::monitor.commit(City::sync_probe);
+
+		if(City::batch_acquire || City::region_aggregation) {
+			// Completes the exchange started once all boundary cities were
+			// executed
+			fpmas::utils::perf::Probe distant_comm_probe {City::DISTANT_COMM_PROBE};
+			City::comm_probe.start();
+			distant_comm_probe.start();
+			City::migration_batch.finish();
+			distant_comm_probe.stop();
+			City::comm_probe.stop();
+			City::monitor.commit(City::comm_probe);
+			City::monitor.commit(distant_comm_probe);
+		}
+	}
+
+	void ExtinctionCheck::run() {
+		double local_infected = 0;
+		for(auto city : model.getGroup(CITY).localAgents())
+			local_infected += dynamic_cast<City*>(city)->population.I;
+
+		fpmas::communication::TypedMpi<double> mpi(model.getMpiCommunicator());
+		double total_infected = 0;
+		for(double infected : mpi.allGather(local_infected))
+			total_infected += infected;
+		_extinct = total_infected < epsilon;
 	}
 
 	const double Disease::delta_t {0.1};
+	Pool<Disease> Disease::pool;
+	int Disease::substeps = 1;
+
+	void* Disease::operator new(std::size_t size) {
+		if(size != sizeof(Disease))
+			return ::operator new(size);
+		return pool.allocate();
+	}
+
+	void Disease::operator delete(void* ptr, std::size_t size) {
+		if(size != sizeof(Disease))
+			::operator delete(ptr);
+		else
+			pool.deallocate(ptr);
+	}
 
 	/**
 	 * Disease Agent Behavior.
 	 */
 	void Disease::propagate_virus() {
+		// Nothing to integrate in quiescent cities. The activity of a LOCAL
+		// city can be read without acquiring it, so sleeping cities cost
+		// neither a neighbor list nor a HARD_SYNC round trip.
+		auto city_node = node()->getOutgoingEdges(DISEASE_TO_CITY)[0]->getTargetNode();
+		if(city_node->state() == fpmas::api::graph::LOCAL
+				&& !static_cast<City*>(city_node->data().get())->active)
+			return;
+
 		// Access the first (and only) neighbor city
 		auto city = outNeighbors<City>(DISEASE_TO_CITY)[0];
 
 		// Acquires the neighbor city
 		fpmas::model::AcquireGuard acquire (city);
 
+		// The activity of a DISTANT city is only known once acquired
+		if(!city->active)
+			return;
+
 		// Updates the city population according to the SIR model
-		city->population = RK4::solve(alpha, beta, delta_t, city->population);
+		for(int i = 0; i < substeps; i++)
+			city->population = RK4::solve(alpha, beta, delta_t, city->population);
 
-		FPMAS_LOGI(this->model()->graph().getMpiCommunicator().getRank(),
-				"DISEASE", "Updated city population : %f, %f, %f",
+		MACROPOP_LOGI("DISEASE", "Updated city population : %f, %f, %f",
 				city->population.S, city->population.I, city->population.R);
 
 		// End of `acquire` scope : automatically releases and commits write
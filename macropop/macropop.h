@@ -1,10 +1,25 @@
+#ifndef MACROPOP_H
+#define MACROPOP_H
+
 #include "fpmas/model/model.h"
 #include "fpmas/model/serializer.h"
 #include "fpmas/utils/perf.h"
 #include "fpmas/graph/random_load_balancing.h"
 #include "config.h"
+#include "pool.h"
+#include <map>
 
 namespace macropop {
+	/**
+	 * Load balancing algorithms of a model, selected by LbMethod.
+	 */
+	class LbMethods {
+		public:
+			virtual fpmas::api::graph::LoadBalancing<fpmas::model::AgentPtr>& loadBalancing(
+					LbMethod lb_method) = 0;
+			virtual ~LbMethods() {}
+	};
+
 	template<template<typename> class SyncMode>
 		class ModelConfig {
 			protected:
@@ -21,29 +36,51 @@ namespace macropop {
 					fpmas::communication::WORLD
 				};
 
+				Engine engine;
 				fpmas::api::graph::LoadBalancing<fpmas::model::AgentPtr>* lb;
-				ModelConfig(LbMethod lb_method) {
+				ModelConfig(LbMethod lb_method, Engine engine)
+					: engine(engine), lb(&loadBalancing(lb_method)) {
+				}
+
+				/**
+				 * Returns the load balancing algorithm used for `lb_method`.
+				 *
+				 * ScheduledLoadBalancing partitions nodes of each scheduled
+				 * agent job in turn, but the spmv engine schedules no agent
+				 * job: in this case, the whole graph is partitioned by Zoltan
+				 * at once.
+				 */
+				fpmas::api::graph::LoadBalancing<fpmas::model::AgentPtr>& loadBalancing(
+						LbMethod lb_method) {
 					switch(lb_method) {
 						case ZOLTAN:
-							lb = &scheduled_lb;
-							break;
-						case RANDOM:
-							lb = &random_lb;
-							break;
+							if(engine == SPMV)
+								return zoltan;
+							return scheduled_lb;
+						default:
+							return random_lb;
 					}
 				}
 		};
 
 	template<template<typename> class SyncMode>
-		class Model : private ModelConfig<SyncMode>, public fpmas::model::detail::Model {
+		class Model :
+			private ModelConfig<SyncMode>,
+			public fpmas::model::detail::Model,
+			public LbMethods {
 			public:
-				Model(LbMethod lb) :
-					ModelConfig<SyncMode>(lb),
+				Model(LbMethod lb, Engine engine) :
+					ModelConfig<SyncMode>(lb, engine),
 					fpmas::model::detail::Model(
 						this->ModelConfig<SyncMode>::graph,
 						this->ModelConfig<SyncMode>::scheduler,
 						this->ModelConfig<SyncMode>::runtime,
 						*this->lb) {}
+
+				fpmas::api::graph::LoadBalancing<fpmas::model::AgentPtr>& loadBalancing(
+						LbMethod lb_method) override {
+					return ModelConfig<SyncMode>::loadBalancing(lb_method);
+				}
 		};
 
 	FPMAS_DEFINE_GROUPS(CITY,DISEASE);
@@ -74,6 +111,153 @@ namespace macropop {
 	Population operator-=(Population& p, const Population& p2);
 	Population operator*(const double& h, const Population& population);
 
+	/**
+	 * Returns the MPI communicator underlying `comm`, for MPI features not
+	 * provided by fpmas (MPI-IO, process topologies, non-blocking
+	 * requests...).
+	 */
+	MPI_Comm mpi_comm(fpmas::api::communication::MpiCommunicator& comm);
+
+	class City;
+
+	/**
+	 * Batch of migrations to distant cities.
+	 *
+	 * In HARD_SYNC mode, migrating population to a distant city requires a
+	 * request/response round trip for each neighbor. When batched
+	 * acquisition is enabled, migrations to distant cities of all local
+	 * cities are instead buffered, grouped by owner rank, and sent to owners
+	 * in a single exchange.
+	 *
+	 * The exchange plan (slot of each distant city in send buffers, and
+	 * local city of each received slot) is built each time
+	 * City::topology_version changes. Only boundary cities, that have at
+	 * least one distant neighbor, contribute to the batch: the exchange is
+	 * started with non-blocking communications as soon as all boundary
+	 * cities have been executed, and is completed after the graph
+	 * synchronization, so that interior cities are executed while
+	 * migrations are in flight.
+	 *
+	 * When region aggregation is enabled, each process is considered as a
+	 * region, and all migrations from a region to another one are summed
+	 * into a single Population. The receiving region splits this flow
+	 * across its cities proportionally to the weights of the CITY_TO_CITY
+	 * edges coming from the sending region. This is exact only if all
+	 * sending cities have the same population, so results should be
+	 * compared to a run without aggregation.
+	 */
+	class MigrationBatch {
+		private:
+			/**
+			 * City::topology_version value at which the exchange plan was
+			 * built
+			 */
+			std::size_t plan_version;
+			/**
+			 * Duplicate of the model communicator, so that batch messages
+			 * can't be matched by fpmas point-to-point communications.
+			 * Never freed, since the batch is only destroyed after
+			 * MPI_Finalize().
+			 */
+			MPI_Comm comm = MPI_COMM_NULL;
+
+			/**
+			 * Slot of each distant city in `send_buffer`. With region
+			 * aggregation, all cities of a process share the same slot.
+			 */
+			std::map<fpmas::api::graph::DistributedId, std::size_t> send_slots;
+			std::vector<int> send_ranks;
+			std::vector<int> send_counts;
+			std::vector<int> send_displs;
+			std::vector<int> recv_ranks;
+			std::vector<int> recv_counts;
+			std::vector<int> recv_displs;
+			/**
+			 * Local cities receiving each slot of `recv_buffer`, with the
+			 * share of the slot received by each city (always 1 without
+			 * region aggregation).
+			 */
+			std::vector<std::vector<std::pair<City*, double>>> recv_cities;
+			std::vector<double> send_buffer;
+			std::vector<double> recv_buffer;
+			std::vector<MPI_Request> requests;
+
+			std::size_t boundary_cities = 0;
+			std::size_t pending_boundary_cities = 0;
+			bool started = false;
+
+			fpmas::utils::perf::Probe overlap_probe;
+			fpmas::utils::perf::Probe halo_wait_probe;
+
+			void build_plan(fpmas::api::model::AgentGraph& graph);
+			void start();
+
+		public:
+			MigrationBatch();
+
+			/**
+			 * Starts a migration step, rebuilding the exchange plan if
+			 * needed. This is a collective operation, that must be called
+			 * before any City is executed (e.g. as the begin task of the
+			 * CITY job).
+			 */
+			void begin(fpmas::api::model::AgentGraph& graph);
+
+			/**
+			 * Buffers a migration to the distant `city`.
+			 */
+			void add(City* city, const Population& migration);
+
+			/**
+			 * Must be called each time a boundary city has been executed,
+			 * even if it is inactive. The exchange is started once all
+			 * boundary cities have been executed.
+			 */
+			void boundaryCityDone();
+
+			/**
+			 * Waits for migrations sent to local cities, and applies them.
+			 *
+			 * This is a collective operation, that must be called once all
+			 * processes are done with HARD_SYNC requests, i.e. after the
+			 * graph synchronization.
+			 */
+			void finish();
+	};
+
+	/**
+	 * Per agent cache of CITY_TO_CITY out neighbors.
+	 *
+	 * Node pointers are stable as long as the topology of the graph is not
+	 * modified. Copies of the cache are always invalid, so that a cache
+	 * never follows an agent copied or moved to another node. Assigning an
+	 * agent, for example when fpmas writes back an acquired copy into the
+	 * local agent, keeps the node of the agent, so its cache is kept.
+	 */
+	struct NeighborCache {
+		static const std::size_t INVALID;
+
+		std::vector<fpmas::api::model::AgentNode*> nodes;
+		/**
+		 * S/I/R ratios of the city population migrated to each neighbor at
+		 * each migration step.
+		 */
+		Population rates;
+		/**
+		 * City::topology_version value at which the cache was built
+		 */
+		std::size_t version = INVALID;
+		/**
+		 * True iff at least one neighbor is DISTANT.
+		 */
+		bool boundary = false;
+
+		NeighborCache() = default;
+		NeighborCache(const NeighborCache&) {}
+		NeighborCache& operator=(const NeighborCache&) {
+			return *this;
+		}
+	};
 
 	/**
 	 * City Agent.
@@ -82,7 +266,10 @@ namespace macropop {
 	 */
 	class City : public fpmas::model::AgentBase<City> {
 		private:
-			void migrate(double m, City*);
+			NeighborCache neighbor_cache;
+
+			void migrate(const Population& rates, City*);
+			const NeighborCache& neighbors();
 
 		public:
 			static fpmas::utils::perf::Monitor monitor;
@@ -90,14 +277,80 @@ namespace macropop {
 			static std::string COMM_PROBE;
 			static std::string DISTANT_COMM_PROBE;
 			static std::string SYNC_PROBE;
+			/**
+			 * Time spent computing (interior cities and graph
+			 * synchronization, or interior spmv rows) while distant
+			 * migrations are in flight.
+			 */
+			static std::string OVERLAP_PROBE;
+			/**
+			 * Time spent waiting for distant migrations, i.e. communication
+			 * time not hidden by the overlap.
+			 */
+			static std::string HALO_WAIT_PROBE;
 			static fpmas::utils::perf::Probe behavior_probe;
 			static fpmas::utils::perf::Probe comm_probe;
 			static fpmas::utils::perf::Probe sync_probe;
 
+			/**
+			 * Population change and infected count under which a City is
+			 * considered quiescent and marked inactive. A value of 0
+			 * disables activity tracking.
+			 *
+			 * The population of inactive cities is frozen, so each of them
+			 * can keep up to `activity_threshold` infected people forever.
+			 * The extinction epsilon must so be at least
+			 * `city_count * activity_threshold`.
+			 */
+			static double activity_threshold;
+			/**
+			 * If true, migrations to distant cities are buffered in
+			 * `migration_batch` instead of being performed with an
+			 * AcquireGuard.
+			 */
+			static bool batch_acquire;
+			/**
+			 * If true, migrations to distant cities are aggregated per
+			 * region in `migration_batch`. Implies batched acquisition.
+			 */
+			static bool region_aggregation;
+			static MigrationBatch migration_batch;
+			/**
+			 * Memory pool used to allocate all City instances, including
+			 * ghosts and cities imported by load balancing.
+			 */
+			static Pool<City> pool;
+			/**
+			 * Version of the graph topology. Must be incremented each time
+			 * CITY_TO_CITY edges are modified or nodes are distributed, to
+			 * invalidate neighbor caches.
+			 */
+			static std::size_t topology_version;
+			/**
+			 * Count of time steps between two migration steps.
+			 */
+			static int migration_period;
+
+			/**
+			 * Returns the migration rate equivalent to `migration_period`
+			 * successive migrations with the rate `g`.
+			 */
+			static double period_rate(double g);
+
 			/**
 			 * Current city population
 			 */
 			Population population;
+			/**
+			 * City population at the end of the last migration step, used
+			 * to detect quiescent cities.
+			 */
+			Population last_population;
+			/**
+			 * Inactive cities are skipped by City and Disease behaviors, until
+			 * infected people migrate to them.
+			 */
+			bool active = true;
 			/**
 			 * Susceptible people migration rate
 			 */
@@ -121,22 +374,112 @@ namespace macropop {
 					const Population& population,
 					double g_s, double g_i, double g_r
 				)
-				: population(population), g_s(g_s), g_i(g_i), g_r(g_r) {}
+				: population(population), last_population(population),
+				g_s(g_s), g_i(g_i), g_r(g_r) {}
 
 			void migrate_population();
 
+			/**
+			 * Adds the `migration` population to this city, and wakes it up
+			 * if its population has changed by at least
+			 * `activity_threshold` since it was put to sleep, or if its
+			 * infected population has reached `activity_threshold`.
+			 *
+			 * The city must be locked or acquired by the caller.
+			 */
+			void receive(const Population& migration);
+
+			static void* operator new(std::size_t size);
+			static void operator delete(void* ptr, std::size_t size);
+
 			static void to_json(::nlohmann::json& j, const City* city);
 			static City* from_json(const ::nlohmann::json& json);
 	};
 
+	/**
+	 * Returns `cities` ordered with the Reverse Cuthill-McKee algorithm
+	 * applied to the undirected graph of local CITY_TO_CITY edges, so that
+	 * neighbor cities are close to each other in the returned order.
+	 */
+	std::vector<City*> rcm_order(const std::vector<City*>& cities);
+
+	/**
+	 * Orders the agent execution job of the CITY group for locality.
+	 *
+	 * Each time City::topology_version changes, local cities are sorted
+	 * with rcm_order(), and their agent tasks are removed from the CITY job
+	 * and added back in this order, so that successive cities share
+	 * neighbors. Boundary cities, with at least one DISTANT neighbor, are
+	 * moved first (keeping their relative order), so that the
+	 * MigrationBatch exchange is started early and overlapped with the
+	 * execution of interior cities. Without batched acquisition, HARD_SYNC
+	 * acquires are blocking, so only the locality of the order applies. As when fpmas imports or exports agents, each removal is
+	 * linear in the size of the job, so the job is only reordered when the
+	 * topology changes.
+	 *
+	 * Agent tasks stay in the CITY job, so that ScheduledLoadBalancing still
+	 * partitions CITY nodes with this job. The task must be scheduled
+	 * before the CITY job, outside of it.
+	 */
+	class CityOrdering : public fpmas::api::scheduler::Task {
+		private:
+			fpmas::api::model::AgentGroup& group;
+			/**
+			 * City::topology_version value at which the job was ordered
+			 */
+			std::size_t ordered_version;
+
+		public:
+			/**
+			 * @param group CITY group
+			 */
+			CityOrdering(fpmas::api::model::AgentGroup& group);
+
+			void run() override;
+	};
+
 	class GraphSyncProbe : public fpmas::api::scheduler::Task {
 		private:
+			fpmas::api::model::AgentGraph& graph;
 			fpmas::model::detail::SynchronizeGraphTask sync_graph_task;
 
 		public:
 			GraphSyncProbe(fpmas::api::model::AgentGraph& graph)
-				: sync_graph_task(graph) {}
+				: graph(graph), sync_graph_task(graph) {}
+			void run() override;
+	};
+
+	/**
+	 * Global termination check.
+	 *
+	 * Reduces the infected population of all local cities across processes,
+	 * so that all processes can stop the simulation at the same time step
+	 * once the epidemic is extinct.
+	 */
+	class ExtinctionCheck : public fpmas::api::scheduler::Task {
+		private:
+			fpmas::api::model::Model& model;
+			double epsilon;
+			bool _extinct = false;
+
+		public:
+			/**
+			 * @param model simulation model
+			 * @param epsilon the epidemic is considered extinct when the
+			 * global infected population falls below this value
+			 */
+			ExtinctionCheck(fpmas::api::model::Model& model, double epsilon)
+				: model(model), epsilon(epsilon) {}
+
 			void run() override;
+
+			/**
+			 * Returns true iff the global infected population was below
+			 * `epsilon` at the last run() call.
+			 */
+			bool extinct() const {
+				return _extinct;
+			}
 	};
 
 	/**
@@ -159,11 +502,21 @@ namespace macropop {
 			 * by ont person at each time step)
 			 */
 			double beta;
+		public:
 			/**
 			 * Integration step
 			 */
 			static const double delta_t;
-		public:
+			/**
+			 * Memory pool used to allocate all Disease instances.
+			 */
+			static Pool<Disease> pool;
+			/**
+			 * Count of RK4 substeps performed at each propagate_virus()
+			 * call. Must be equal to the period of the DISEASE jobs.
+			 */
+			static int substeps;
+
 			/**
 			 * Default constructor used for "light_json" edge transmission
 			 * optimization.
@@ -175,6 +528,9 @@ namespace macropop {
 
 			void propagate_virus();
 
+			static void* operator new(std::size_t size);
+			static void operator delete(void* ptr, std::size_t size);
+
 			static void to_json(::nlohmann::json& j, const Disease* disease);
 			static Disease* from_json(const ::nlohmann::json& json);
 	};
@@ -199,3 +555,4 @@ namespace macropop {
 			static Population solve(double alpha, double beta, double h, const Population& population);
 	};
 }
+#endif
@@ -1,6 +1,9 @@
 #include "fpmas.h"
 #include "output.h"
 #include "cli.h"
+#include "spmv.h"
+#include "log.h"
+#include "autotune.h"
 #include "fpmas/random/generator.h"
 #include "fpmas/random/distribution.h"
 #include "fpmas/graph/graph_builder.h"
@@ -28,13 +31,21 @@ int main(int argc, char** argv) {
 		fpmas::api::model::Model* model;
 		switch(config.sync_mode) {
 			case GHOST:
-				model = new Model<GhostMode>(config.lb_method);
+				model = new Model<GhostMode>(config.lb_method, config.engine);
 				break;
 			case HARD_SYNC:
-				model = new Model<HardSyncMode>(config.lb_method);
+				model = new Model<HardSyncMode>(config.lb_method, config.engine);
 				break;
 		}
 		rank = model->getMpiCommunicator().getRank();
+		macropop::log::Logger::instance().init(rank, config.output_dir + "macropop.%r.log");
+
+		City::activity_threshold = config.activity_threshold;
+		City::migration_period = config.migration_period;
+		Disease::substeps = config.disease_period;
+		// Batched acquisition relies on HARD_SYNC semantics
+		City::batch_acquire = config.batch_acquire && config.sync_mode == HARD_SYNC;
+		City::region_aggregation = config.region_aggregation && config.sync_mode == HARD_SYNC;
 
 		fpmas::model::Behavior<City> city_behavior {&City::migrate_population};
 		auto& city_group = model->buildGroup(CITY, city_behavior);
@@ -43,6 +54,13 @@ int main(int argc, char** argv) {
 
 		GraphSyncProbe graph_sync_probe(model->graph());
 		city_group.agentExecutionJob().setEndTask(graph_sync_probe);
+		// Prepares the batch exchange, started once boundary cities are
+		// executed and completed by graph_sync_probe
+		fpmas::scheduler::detail::LambdaTask migration_batch_task([model] () {
+				if(City::batch_acquire || City::region_aggregation)
+					City::migration_batch.begin(model->graph());
+				});
+		city_group.agentExecutionJob().setBeginTask(migration_batch_task);
 
 		// Model initialization
 		{
@@ -120,6 +138,9 @@ int main(int argc, char** argv) {
 
 		// Task run just after loadBalancingJob
 		fpmas::scheduler::detail::LambdaTask post_lb_task([&config, model] () {
+				// Nodes have been distributed
+				City::topology_version++;
+
 				TimeOutput::lb_probe.stop();
 				TimeOutput::init_probe.stop();
 
@@ -128,25 +149,137 @@ int main(int argc, char** argv) {
 				});
 		fpmas::scheduler::Job post_lb_job({post_lb_task});
 
+		// Writes buffered log records at the end of each time step
+		fpmas::scheduler::detail::LambdaTask log_flush_task([] () {
+				macropop::log::Logger::instance().flush();
+				});
+		fpmas::scheduler::Job log_flush_job({log_flush_task});
+
+		// Global epidemic termination check
+		ExtinctionCheck extinction_check(*model, config.extinction_epsilon);
+		fpmas::scheduler::Job extinction_job({extinction_check});
+
+		// Topology-aware remapping of partitions, run just after
+		// loadBalancingJob
+		RankRemapping rank_remapping(*model, config.rank_remap);
+		fpmas::scheduler::Job rank_remapping_job({rank_remapping});
+
 		// Performs load balancing at the beginning of the simulation
 		model->scheduler().schedule(0, model->loadBalancingJob());
+		model->scheduler().schedule(0.05, rank_remapping_job);
 		model->scheduler().schedule(0.1, post_lb_job);
 
+		// Sparse matrix engine, only used with `--engine spmv`
+		SpmvEngine spmv_engine(*model, config.alpha, config.beta);
+
+		// Multi-rate steps: with Lie splitting, each operator is applied at
+		// the beginning of its period. With Strang splitting, it is applied
+		// in the middle of its period, so that steps of the other operator
+		// are split around it (periods are 1 or even with Strang splitting,
+		// see Config). In both cases, a last partial period before max_step
+		// is not integrated.
+		auto period_offset = [&config] (int period) {
+			return config.splitting == STRANG ? period / 2 : 0;
+		};
+		fpmas::scheduler::Date migration_date
+			= 0.2 + period_offset(config.migration_period);
+		fpmas::scheduler::Date disease_date
+			= 0.21 + period_offset(config.disease_period);
+
+		// Orders the CITY job for locality before each step
+		CityOrdering city_ordering(city_group);
+		fpmas::scheduler::Job city_ordering_job({city_ordering});
+
 		// Schedules agents and output jobs
-		model->scheduler().schedule(0.2, 1, city_group.jobs());
-		model->scheduler().schedule(0.21, 1, disease_group.jobs());
+		switch(config.engine) {
+			case AGENT:
+				model->scheduler().schedule(0.15, 1, city_ordering_job);
+				model->scheduler().schedule(
+						migration_date, config.migration_period, city_group.jobs());
+				model->scheduler().schedule(
+						disease_date, config.disease_period, disease_group.jobs());
+				break;
+			case SPMV:
+				model->scheduler().schedule(
+						migration_date, config.migration_period, spmv_engine.migration_job());
+				model->scheduler().schedule(
+						disease_date, config.disease_period, spmv_engine.disease_job());
+				break;
+		}
 		model->scheduler().schedule(0.22, 1, model_output.job());
+		model->scheduler().schedule(0.25, 1, log_flush_job);
+		if(config.extinction_epsilon > 0)
+			model->scheduler().schedule(0.23, 1, extinction_job);
+
+		// Memory footprint outputs. Aggregated performance outputs avoid
+		// per-rank files: only the mem.csv summary is written in this case.
+		std::unique_ptr<MemoryOutput> memory_output;
+		if(config.perf_output == PER_RANK)
+			memory_output.reset(new MemoryOutput(
+					config.output_dir + "mem.%r.csv",
+					model->getMpiCommunicator().getRank(), *model, spmv_engine
+					));
+		MemorySummaryOutput memory_summary_output(
+				config.output_dir + "mem.csv", *model, spmv_engine
+				);
+		if(config.mem_period > 0) {
+			if(memory_output)
+				model->scheduler().schedule(0.24, config.mem_period, memory_output->job());
+			else
+				model->scheduler().schedule(0.24, config.mem_period, memory_summary_output.job());
+		}
 
 		// Runs the model simulation
 		TimeOutput::lb_probe.start(); // LB = First task executed
-		model->runtime().run(config.max_step);
+		if(config.extinction_epsilon > 0 || config.autotune) {
+			// Runs the simulation step by step, until max_step is reached or
+			// the epidemic is extinct
+			fpmas::scheduler::TimeStep step = 0;
+			fpmas::scheduler::TimeStep max_step = config.max_step;
+			auto run_steps = [&] (fpmas::scheduler::TimeStep count) {
+				fpmas::scheduler::TimeStep end = step + count;
+				fpmas::scheduler::TimeStep begin = step;
+				while(step < end && step < max_step
+						&& !extinction_check.extinct()) {
+					model->runtime().run(step, step+1);
+					step++;
+				}
+				return step - begin;
+			};
+			if(config.autotune) {
+				// The first step performs the initial load balancing
+				run_steps(1);
+				// Batched acquisition has no effect with region aggregation
+				// or with the spmv engine
+				Autotuner autotuner(
+						*model, dynamic_cast<LbMethods&>(*model), config.sync_mode,
+						!City::region_aggregation && config.engine == AGENT);
+				autotuner.calibrate(run_steps, config.autotune_steps);
+				TimeOutput::autotune = autotuner.report();
+				// Candidates are partitioned from scratch, so the remapping
+				// is performed again on the chosen partition
+				rank_remapping.run();
+			}
+			run_steps(max_step);
+		} else {
+			model->runtime().run(config.max_step);
+		}
 		TimeOutput::run_probe.stop();
 
 		// Performs behavior and distant comm times output
-		ProbeOutput(
-				config.output_dir + "perf.%r.csv",
-				model->getMpiCommunicator().getRank()
-				).dump();
+		if(config.perf_output == PER_RANK) {
+			ProbeOutput(
+					config.output_dir + "perf.%r.csv",
+					model->getMpiCommunicator().getRank()
+					).dump();
+		} else {
+			std::ostringstream csv;
+			ProbeCsvOutput probe_output(csv);
+			AggregatedOutput(
+					config.output_dir + "perf.csv", config.perf_output,
+					model->getMpiCommunicator()
+					).dump(probe_output, csv);
+		}
 
 		// Commits all global time probes
 		TimeOutput::monitor.commit(TimeOutput::builder_probe);
@@ -162,10 +295,32 @@ int main(int argc, char** argv) {
 				).dump();
 
 		// Performs load balancing stats output
-		LbOutput(
-				config.output_dir + "lb.%r.csv",
-				model->getMpiCommunicator().getRank(), model->graph()
-				).dump();
+		if(config.perf_output == PER_RANK) {
+			LbOutput(
+					config.output_dir + "lb.%r.csv",
+					model->getMpiCommunicator().getRank(), model->graph()
+					).dump();
+		} else {
+			std::ostringstream csv;
+			LbCsvOutput lb_output(csv, model->graph());
+			AggregatedOutput(
+					config.output_dir + "lb.csv", config.perf_output,
+					model->getMpiCommunicator()
+					).dump(lb_output, csv);
+		}
+
+		// Performs rank remapping output
+		if(config.rank_remap != NO_REMAP)
+			RemapOutput(
+					config.output_dir + "remap.csv", rank_remapping,
+					model->getMpiCommunicator()
+					).dump();
+
+		// Performs memory footprint outputs
+		if(config.mem_period == 0 && memory_output)
+			memory_output->dump();
+		if(config.mem_period == 0 || memory_output)
+			memory_summary_output.dump();
 	}
 
 	fpmas::finalize();
@@ -1,11 +1,16 @@
 #include "output.h"
 #include <fstream>
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <numeric>
 
 namespace macropop {
 
-	ProbeOutput::ProbeOutput(std::string file_name, int rank)
-		: FileOutput(file_name, rank), CsvOutput(
-				this->file,
+	ProbeCsvOutput::ProbeCsvOutput(std::ostream& output)
+		: CsvOutput(
+				output,
 				{"behavior_time", [] () {
 				return std::chrono::duration_cast<time_unit>(
 						City::monitor.totalDuration(City::BEHAVIOR_PROBE));
@@ -22,11 +27,25 @@ namespace macropop {
 				return std::chrono::duration_cast<time_unit>(
 						City::monitor.totalDuration(City::SYNC_PROBE));
 				}},
+				{"overlap_time", [] () {
+				return std::chrono::duration_cast<time_unit>(
+						City::monitor.totalDuration(City::OVERLAP_PROBE));
+				}},
+				{"halo_wait_time", [] () {
+				return std::chrono::duration_cast<time_unit>(
+						City::monitor.totalDuration(City::HALO_WAIT_PROBE));
+				}},
 				{"comm_count", [] () {
 				return City::monitor.callCount(City::COMM_PROBE);
 				}},
 				{"distant_comm_count", [] () {
 				return City::monitor.callCount(City::DISTANT_COMM_PROBE);
+				}},
+				{"agent_alloc_count", [] () {
+				return City::pool.allocationCount() + Disease::pool.allocationCount();
+				}},
+				{"agent_slab_count", [] () {
+				return City::pool.slabCount() + Disease::pool.slabCount();
 				}}) {
 	}
 
@@ -36,10 +55,11 @@ namespace macropop {
 	fpmas::utils::perf::Probe TimeOutput::init_probe {"init"};
 	fpmas::utils::perf::Probe TimeOutput::run_probe {"run"};
 	fpmas::utils::perf::Monitor TimeOutput::monitor;
+	std::string TimeOutput::autotune;
 
 	TimeOutput::TimeOutput(std::string file_name, fpmas::api::communication::MpiCommunicator& comm)
 		: FileOutput(file_name),
-		DistributedCsvOutput<Local<time_unit>, Local<time_unit>, Local<time_unit>, Local<time_unit>, Local<time_unit>>(comm, 0, this->file,
+		DistributedCsvOutput<Local<time_unit>, Local<time_unit>, Local<time_unit>, Local<time_unit>, Local<time_unit>, Local<std::string>>(comm, 0, this->file,
 				{builder_probe.label(), [this] () {
 				return std::chrono::duration_cast<time_unit>(
 						monitor.totalDuration(builder_probe.label()));
@@ -63,14 +83,38 @@ namespace macropop {
 				return std::chrono::duration_cast<time_unit>(
 						monitor.totalDuration(run_probe.label())
 						);
+				}},
+				{"autotune", [] () {
+				return autotune;
 				}}) {
 	}
 
-	LbOutput::LbOutput(
-			std::string file_format, int rank,
+	/**
+	 * Counts local cities with (boundary) or without (interior) distant
+	 * CITY_TO_CITY neighbors.
+	 */
+	static std::size_t city_count(
+			fpmas::api::graph::DistributedGraph<fpmas::model::AgentPtr>& graph,
+			bool boundary) {
+		std::size_t count = 0;
+		for(auto node : graph.getLocationManager().getLocalNodes()) {
+			if(dynamic_cast<City*>(node.second->data().get()) == nullptr)
+				continue;
+			bool distant_neighbor = false;
+			for(auto edge : node.second->getOutgoingEdges(CITY_TO_CITY))
+				if(edge->getTargetNode()->state() == fpmas::api::graph::DISTANT)
+					distant_neighbor = true;
+			if(distant_neighbor == boundary)
+				count++;
+		}
+		return count;
+	}
+
+	LbCsvOutput::LbCsvOutput(
+			std::ostream& output,
 			fpmas::api::graph::DistributedGraph<fpmas::model::AgentPtr>& graph
 			)
-		: FileOutput(file_format, rank), CsvOutput<std::size_t, std::size_t, std::size_t, std::size_t>(this->file,
+		: CsvOutput<std::size_t, std::size_t, std::size_t, std::size_t, std::size_t, std::size_t>(output,
 				{"LOCAL_NODES", [&graph] () {
 				return graph.getLocationManager().getLocalNodes().size();
 				}},
@@ -88,9 +132,247 @@ namespace macropop {
 				for(auto node : graph.getLocationManager().getDistantNodes())
 						d_to_c += node.second->getOutgoingEdges(DISEASE_TO_CITY).size();
 				return d_to_c;
+				}},
+				{"INTERIOR_CITIES", [&graph] () {
+				return city_count(graph, false);
+				}},
+				{"BOUNDARY_CITIES", [&graph] () {
+				return city_count(graph, true);
 				}}) {
 		}
 
+	void AggregatedOutput::dump(fpmas::api::io::Output& output, std::ostringstream& csv) {
+		output.dump();
+		std::istringstream lines(csv.str());
+		std::string header;
+		std::string row;
+		std::getline(lines, header);
+		std::getline(lines, row);
+
+		switch(mode) {
+			case AGGREGATED_STATS:
+				write(stats(header, row));
+				break;
+			default:
+				{
+					std::string data = std::to_string(comm.getRank()) + "," + row + "\n";
+					if(comm.getRank() == 0)
+						data = "rank," + header + "\n" + data;
+					write(data);
+				}
+		}
+	}
+
+	std::string AggregatedOutput::stats(const std::string& header, const std::string& row) {
+		std::vector<double> values;
+		std::istringstream fields(row);
+		std::string field;
+		while(std::getline(fields, field, ','))
+			values.push_back(std::stod(field));
+
+		std::vector<double> all_values(comm.getRank() == 0 ? values.size() * comm.getSize() : 0);
+		MPI_Gather(
+				values.data(), values.size(), MPI_DOUBLE,
+				all_values.data(), values.size(), MPI_DOUBLE,
+				0, mpi_comm(comm));
+		if(comm.getRank() != 0)
+			return "";
+
+		std::vector<std::vector<double>> columns(values.size());
+		for(std::size_t i = 0; i < all_values.size(); i++)
+			columns[i % values.size()].push_back(all_values[i]);
+		for(auto& column : columns)
+			std::sort(column.begin(), column.end());
+
+		// Nearest-rank percentile
+		auto percentile = [] (const std::vector<double>& column, double p) {
+			std::size_t rank = std::ceil(p / 100 * column.size());
+			return column[rank > 0 ? rank-1 : 0];
+		};
+		std::ostringstream data;
+		// Large counts are written in full rather than in scientific
+		// notation
+		data << std::setprecision(std::numeric_limits<double>::digits10);
+		data << "stat," << header << "\n";
+		for(std::string stat : {"min", "mean", "max", "p50", "p90", "p99"}) {
+			data << stat;
+			for(auto& column : columns) {
+				double value;
+				if(stat == "min")
+					value = column.front();
+				else if(stat == "mean")
+					value = std::accumulate(column.begin(), column.end(), 0.) / column.size();
+				else if(stat == "max")
+					value = column.back();
+				else
+					value = percentile(column, std::stod(stat.substr(1)));
+				data << "," << value;
+			}
+			data << "\n";
+		}
+		return data.str();
+	}
+
+	void AggregatedOutput::write(const std::string& data) {
+		long long size = data.size();
+		long long offset = 0;
+		MPI_Exscan(&size, &offset, 1, MPI_LONG_LONG, MPI_SUM, mpi_comm(comm));
+		// MPI_Exscan leaves the result undefined on rank 0
+		if(comm.getRank() == 0)
+			offset = 0;
+
+		MPI_File file;
+		// MPI_File_open is collective, so all processes skip the write
+		// together if the file can't be opened
+		int error = MPI_File_open(
+				mpi_comm(comm), file_name.c_str(),
+				MPI_MODE_CREATE | MPI_MODE_WRONLY, MPI_INFO_NULL, &file);
+		if(error != MPI_SUCCESS) {
+			if(comm.getRank() == 0)
+				std::cerr << "Could not open output file " << file_name
+					<< ", skipping write" << std::endl;
+			return;
+		}
+		MPI_File_set_size(file, 0);
+		MPI_File_write_at_all(
+				file, offset, data.data(), data.size(), MPI_CHAR, MPI_STATUS_IGNORE);
+		MPI_File_close(&file);
+	}
+
+	RemapOutput::RemapOutput(
+			std::string file_name,
+			const RankRemapping& remapping,
+			fpmas::api::communication::MpiCommunicator& comm)
+		: FileOutput(file_name), DistributedCsvOutput(comm, 0, this->file,
+				{"INTER_NODE_BYTES_BEFORE", [&remapping] () {
+				return remapping.interNodeBytesBefore();
+				}},
+				{"INTER_NODE_BYTES_AFTER", [&remapping] () {
+				return remapping.interNodeBytesAfter();
+				}}) {
+		}
+
+	/**
+	 * Reads a memory size, in kB, from /proc/self/status.
+	 */
+	static std::size_t read_proc_status(const std::string& key) {
+		std::ifstream status("/proc/self/status");
+		std::string line;
+		while(std::getline(status, line))
+			if(line.compare(0, key.size(), key) == 0)
+				return std::stoul(line.substr(key.size())) * 1024;
+		return 0;
+	}
+
+	/**
+	 * Estimated size of nodes and their agents.
+	 */
+	static std::size_t node_bytes(
+			const fpmas::api::graph::NodeMap<fpmas::model::AgentPtr>& nodes) {
+		std::size_t bytes = 0;
+		for(auto node : nodes) {
+			bytes += sizeof(fpmas::graph::DistributedNode<fpmas::model::AgentPtr>);
+			auto agent = node.second->data().get();
+			if(dynamic_cast<City*>(agent) != nullptr)
+				bytes += sizeof(City);
+			else if(dynamic_cast<Disease*>(agent) != nullptr)
+				bytes += sizeof(Disease);
+		}
+		return bytes;
+	}
+
+	MemoryUsage::MemoryUsage(
+			fpmas::api::graph::DistributedGraph<fpmas::model::AgentPtr>& graph,
+			const SpmvEngine& engine) :
+		peak_rss(read_proc_status("VmHWM:")),
+		current_rss(read_proc_status("VmRSS:")),
+		local_agents(node_bytes(graph.getLocationManager().getLocalNodes())),
+		ghosts(node_bytes(graph.getLocationManager().getDistantNodes())),
+		edges(graph.getEdges().size()
+				* sizeof(fpmas::graph::DistributedEdge<fpmas::model::AgentPtr>)),
+		engine(engine.memoryFootprint()) {
+		}
+
+	MemoryOutput::MemoryOutput(
+			std::string file_format, int rank,
+			fpmas::api::model::Model& model,
+			const SpmvEngine& engine)
+		: FileOutput(file_format, rank), CsvOutput<
+		  fpmas::scheduler::TimeStep,
+		  std::size_t, std::size_t, std::size_t,
+		  std::size_t, std::size_t, std::size_t>(this->file,
+				{"T", [&model] () {return model.runtime().currentDate();}},
+				{"PEAK_RSS", [this] () {
+				return usage.peak_rss;
+				}},
+				{"CURRENT_RSS", [this] () {
+				return usage.current_rss;
+				}},
+				{"LOCAL_AGENTS", [this] () {
+				return usage.local_agents;
+				}},
+				{"GHOSTS", [this] () {
+				return usage.ghosts;
+				}},
+				{"EDGES", [this] () {
+				return usage.edges;
+				}},
+				{"ENGINE", [this] () {
+				return usage.engine;
+				}}),
+		model(model), engine(engine) {
+		}
+
+	void MemoryOutput::dump() {
+		usage = MemoryUsage(model.graph(), engine);
+		CsvOutput::dump();
+	}
+
+	MemorySummaryOutput::MemorySummaryOutput(
+			std::string file_name,
+			fpmas::api::model::Model& model,
+			const SpmvEngine& engine)
+		: FileOutput(file_name), DistributedCsvOutput(
+				model.getMpiCommunicator(), 0, this->file,
+				{"T", [&model] () {return model.runtime().currentDate();}},
+				{"PEAK_RSS_MIN", [this] () {
+				return usage.peak_rss;
+				}},
+				{"PEAK_RSS_MEAN", [this, &model] () {
+				return (double) usage.peak_rss
+				/ model.getMpiCommunicator().getSize();
+				}},
+				{"PEAK_RSS_MAX", [this] () {
+				return usage.peak_rss;
+				}},
+				{"CURRENT_RSS_MIN", [this] () {
+				return usage.current_rss;
+				}},
+				{"CURRENT_RSS_MEAN", [this, &model] () {
+				return (double) usage.current_rss
+				/ model.getMpiCommunicator().getSize();
+				}},
+				{"CURRENT_RSS_MAX", [this] () {
+				return usage.current_rss;
+				}},
+				{"ESTIMATED_MIN", [this] () {
+				return usage.estimated();
+				}},
+				{"ESTIMATED_MEAN", [this, &model] () {
+				return (double) usage.estimated()
+				/ model.getMpiCommunicator().getSize();
+				}},
+				{"ESTIMATED_MAX", [this] () {
+				return usage.estimated();
+				}}),
+		model(model), engine(engine) {
+		}
+
+	void MemorySummaryOutput::dump() {
+		usage = MemoryUsage(model.graph(), engine);
+		DistributedCsvOutput::dump();
+	}
+
 	const Population& GlobalPopulationOutput::total_population() {
 		if(model.runtime().currentDate() >= buffer_date) {
 			buffer_date = model.runtime().currentDate();
@@ -1,23 +1,37 @@
 #include "fpmas/model/model.h"
 #include "fpmas/io/output.h"
 #include "fpmas/io/csv_output.h"
+#include <algorithm>
+#include <sstream>
 
 #include "macropop.h"
+#include "spmv.h"
+#include "remap.h"
 
 namespace macropop {
 	using namespace fpmas::io;
 	typedef std::chrono::milliseconds time_unit;
 
-	class ProbeOutput : public FileOutput, public CsvOutput<
+	class ProbeCsvOutput : public CsvOutput<
 						time_unit,
 						time_unit,
 						time_unit,
 						time_unit,
+						time_unit,
+						time_unit,
+						std::size_t,
+						std::size_t,
 						std::size_t,
 						std::size_t>
 	{
 		public:
-			ProbeOutput(std::string file_name, int rank);
+			ProbeCsvOutput(std::ostream& output);
+	};
+
+	class ProbeOutput : public FileOutput, public ProbeCsvOutput {
+		public:
+			ProbeOutput(std::string file_name, int rank)
+				: FileOutput(file_name, rank), ProbeCsvOutput(this->file) {}
 	};
 
 	class TimeOutput : public FileOutput, public DistributedCsvOutput<
@@ -25,7 +39,8 @@ namespace macropop {
 					   Local<time_unit>,
 					   Local<time_unit>,
 					   Local<time_unit>,
-					   Local<time_unit>
+					   Local<time_unit>,
+					   Local<std::string>
 					   >
 	{
 		public:
@@ -35,21 +50,206 @@ namespace macropop {
 			static fpmas::utils::perf::Probe init_probe;
 			static fpmas::utils::perf::Probe run_probe;
 			static fpmas::utils::perf::Monitor monitor;
+			/**
+			 * Autotune calibration timings, with the window of time steps
+			 * of each candidate, and chosen configuration. Empty if
+			 * autotune is disabled.
+			 */
+			static std::string autotune;
 
 			TimeOutput(std::string file_name, fpmas::api::communication::MpiCommunicator& comm);
 	};
 
-	class LbOutput : public FileOutput, public CsvOutput<
+	class LbCsvOutput : public CsvOutput<
+					 std::size_t,
+					 std::size_t,
 					 std::size_t,
 					 std::size_t,
 					 std::size_t,
 					 std::size_t>
 	{
+		public:
+			LbCsvOutput(
+					std::ostream& output,
+					fpmas::api::graph::DistributedGraph<fpmas::model::AgentPtr>& graph
+					);
+	};
+
+	class LbOutput : public FileOutput, public LbCsvOutput {
 		public:
 			LbOutput(
 					std::string file_format, int rank,
 					fpmas::api::graph::DistributedGraph<fpmas::model::AgentPtr>& graph
+					) : FileOutput(file_format, rank), LbCsvOutput(this->file, graph) {}
+	};
+
+	/**
+	 * Single file output of per process statistics, such as ProbeCsvOutput
+	 * or LbCsvOutput rows.
+	 *
+	 * Instead of creating a file per process, rows of all processes are
+	 * written to a single file with collective MPI-IO operations, either as
+	 * is (AGGREGATED_RAW mode, with an additional "rank" column), or reduced
+	 * to min/mean/max/p50/p90/p99 rows (AGGREGATED_STATS mode, with an
+	 * additional "stat" column).
+	 */
+	class AggregatedOutput {
+		private:
+			std::string file_name;
+			PerfOutputMode mode;
+			fpmas::api::communication::MpiCommunicator& comm;
+
+			void write(const std::string& data);
+			std::string stats(const std::string& header, const std::string& row);
+
+		public:
+			/**
+			 * @param file_name output file
+			 * @param mode AGGREGATED_RAW or AGGREGATED_STATS
+			 * @param comm communicator of the model
+			 */
+			AggregatedOutput(
+					std::string file_name, PerfOutputMode mode,
+					fpmas::api::communication::MpiCommunicator& comm)
+				: file_name(file_name), mode(mode), comm(comm) {}
+
+			/**
+			 * Dumps the statistics of the current process to the aggregated
+			 * file. This is a collective operation.
+			 *
+			 * @param output CSV output writing a row of statistics into a
+			 * stream
+			 * @param csv stream written by `output`
+			 */
+			void dump(fpmas::api::io::Output& output, std::ostringstream& csv);
+	};
+
+	class RemapOutput : public FileOutput, public DistributedCsvOutput<
+						Local<std::size_t>,
+						Local<std::size_t>
+						>
+	{
+		public:
+			RemapOutput(
+					std::string file_name,
+					const RankRemapping& remapping,
+					fpmas::api::communication::MpiCommunicator& comm
+					);
+	};
+
+	template<typename T>
+		struct Min {
+			T operator()(const T& t1, const T& t2) const {
+				return std::min(t1, t2);
+			}
+		};
+
+	template<typename T>
+		struct Max {
+			T operator()(const T& t1, const T& t2) const {
+				return std::max(t1, t2);
+			}
+		};
+
+	/**
+	 * Estimated memory usage of the current process, in bytes.
+	 */
+	struct MemoryUsage {
+		/**
+		 * Peak resident set size.
+		 */
+		std::size_t peak_rss = 0;
+		/**
+		 * Current resident set size.
+		 */
+		std::size_t current_rss = 0;
+		/**
+		 * Local nodes and agents.
+		 */
+		std::size_t local_agents = 0;
+		/**
+		 * Distant nodes and ghost agents.
+		 */
+		std::size_t ghosts = 0;
+		/**
+		 * Local and distant edges.
+		 */
+		std::size_t edges = 0;
+		/**
+		 * Buffers of the sparse matrix engine.
+		 */
+		std::size_t engine = 0;
+
+		MemoryUsage() = default;
+		MemoryUsage(
+				fpmas::api::graph::DistributedGraph<fpmas::model::AgentPtr>& graph,
+				const SpmvEngine& engine);
+
+		/**
+		 * Sum of all estimated categories.
+		 */
+		std::size_t estimated() const {
+			return local_agents + ghosts + edges + engine;
+		}
+	};
+
+	class MemoryOutput : public FileOutput, public CsvOutput<
+						 fpmas::scheduler::TimeStep,
+						 std::size_t,
+						 std::size_t,
+						 std::size_t,
+						 std::size_t,
+						 std::size_t,
+						 std::size_t>
+	{
+		private:
+			fpmas::api::model::Model& model;
+			const SpmvEngine& engine;
+			MemoryUsage usage;
+
+		public:
+			MemoryOutput(
+					std::string file_format, int rank,
+					fpmas::api::model::Model& model,
+					const SpmvEngine& engine
+					);
+
+			/**
+			 * Measures the memory usage once, and writes it as a row.
+			 */
+			void dump() override;
+	};
+
+	class MemorySummaryOutput : public FileOutput, public DistributedCsvOutput<
+								Local<fpmas::scheduler::TimeStep>,
+								Reduce<std::size_t, Min<std::size_t>>,
+								Reduce<double>,
+								Reduce<std::size_t, Max<std::size_t>>,
+								Reduce<std::size_t, Min<std::size_t>>,
+								Reduce<double>,
+								Reduce<std::size_t, Max<std::size_t>>,
+								Reduce<std::size_t, Min<std::size_t>>,
+								Reduce<double>,
+								Reduce<std::size_t, Max<std::size_t>>
+								>
+	{
+		private:
+			fpmas::api::model::Model& model;
+			const SpmvEngine& engine;
+			MemoryUsage usage;
+
+		public:
+			MemorySummaryOutput(
+					std::string file_name,
+					fpmas::api::model::Model& model,
+					const SpmvEngine& engine
 					);
+
+			/**
+			 * Measures the memory usage once, and writes reduced values as
+			 * a row. This is a collective operation.
+			 */
+			void dump() override;
 	};
 
 	class GlobalPopulationOutput :
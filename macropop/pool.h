@@ -0,0 +1,87 @@
+#ifndef MACROPOP_POOL_H
+#define MACROPOP_POOL_H
+
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+namespace macropop {
+
+	/**
+	 * Fixed size object pool.
+	 *
+	 * Memory is reserved in contiguous slabs of `SlabSize` blocks of
+	 * `sizeof(T)` bytes. Released blocks are pushed to a free list, and
+	 * reused by next allocations, so that agents created and destroyed by
+	 * load balancing and ghost updates do not go through the heap
+	 * allocator.
+	 *
+	 * Slabs are only released when the pool is destroyed.
+	 */
+	template<typename T, std::size_t SlabSize = 1024>
+		class Pool {
+			private:
+				union Block {
+					Block* next;
+					alignas(T) unsigned char storage[sizeof(T)];
+				};
+
+				std::vector<std::unique_ptr<Block[]>> slabs;
+				Block* free_list = nullptr;
+				std::size_t _allocation_count = 0;
+
+				void grow() {
+					slabs.emplace_back(new Block[SlabSize]);
+					Block* slab = slabs.back().get();
+					for(std::size_t i = 0; i < SlabSize; i++) {
+						slab[i].next = free_list;
+						free_list = &slab[i];
+					}
+				}
+
+			public:
+				Pool() = default;
+				Pool(const Pool&) = delete;
+				Pool& operator=(const Pool&) = delete;
+
+				/**
+				 * Returns an uninitialized memory block suitable to store a
+				 * `T` instance.
+				 */
+				void* allocate() {
+					if(free_list == nullptr)
+						grow();
+					Block* block = free_list;
+					free_list = block->next;
+					_allocation_count++;
+					return block->storage;
+				}
+
+				/**
+				 * Returns to the pool a block previously returned by
+				 * allocate(). Does nothing if `ptr` is null.
+				 */
+				void deallocate(void* ptr) {
+					if(ptr == nullptr)
+						return;
+					Block* block = reinterpret_cast<Block*>(ptr);
+					block->next = free_list;
+					free_list = block;
+				}
+
+				/**
+				 * Total count of allocate() calls.
+				 */
+				std::size_t allocationCount() const {
+					return _allocation_count;
+				}
+
+				/**
+				 * Count of slabs allocated from the heap.
+				 */
+				std::size_t slabCount() const {
+					return slabs.size();
+				}
+		};
+}
+#endif
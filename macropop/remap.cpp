@@ -0,0 +1,209 @@
+#include "remap.h"
+#include "fpmas/communication/communication.h"
+#include <algorithm>
+#include <climits>
+#include <numeric>
+#include <set>
+
+namespace macropop {
+
+	void RankRemapping::gather_weights() {
+		local_weights.clear();
+		for(auto city : model.getGroup(CITY).localAgents()) {
+			for(auto edge : city->node()->getOutgoingEdges(CITY_TO_CITY))
+				if(edge->getTargetNode()->state() == fpmas::api::graph::DISTANT)
+					local_weights[edge->getTargetNode()->location()]++;
+			for(auto edge : city->node()->getIncomingEdges(CITY_TO_CITY))
+				if(edge->getSourceNode()->state() == fpmas::api::graph::DISTANT)
+					local_weights[edge->getSourceNode()->location()]++;
+		}
+		fpmas::communication::TypedMpi<std::map<int, unsigned long long>> mpi(
+				model.getMpiCommunicator());
+		weights = mpi.gather(local_weights, 0);
+	}
+
+	void RankRemapping::gather_compute_nodes() {
+		int rank = model.getMpiCommunicator().getRank();
+
+		// Processes sharing memory are located on the same compute node,
+		// identified by the rank of its first process
+		MPI_Comm node_comm;
+		MPI_Comm_split_type(
+				mpi_comm(model.getMpiCommunicator()), MPI_COMM_TYPE_SHARED,
+				rank, MPI_INFO_NULL, &node_comm);
+		int compute_node = rank;
+		MPI_Bcast(&compute_node, 1, MPI_INT, 0, node_comm);
+		MPI_Comm_free(&node_comm);
+
+		fpmas::communication::TypedMpi<int> mpi(model.getMpiCommunicator());
+		compute_nodes = mpi.gather(compute_node, 0);
+	}
+
+	std::size_t RankRemapping::inter_node_bytes(const std::vector<int>& mapping) const {
+		std::size_t edges = 0;
+		for(std::size_t p = 0; p < weights.size(); p++)
+			for(auto& weight : weights[p]) {
+				std::size_t q = weight.first;
+				if(q > p && compute_nodes[mapping[p]] != compute_nodes[mapping[q]])
+					edges += weight.second;
+			}
+		return edges * sizeof(Population);
+	}
+
+	std::vector<int> RankRemapping::dist_graph_mapping() {
+		std::vector<int> neighbors;
+		std::vector<int> neighbor_weights;
+		for(auto& weight : local_weights) {
+			neighbors.push_back(weight.first);
+			neighbor_weights.push_back(
+					std::min<unsigned long long>(weight.second, INT_MAX));
+		}
+
+		MPI_Comm graph_comm;
+		MPI_Dist_graph_create_adjacent(
+				mpi_comm(model.getMpiCommunicator()),
+				neighbors.size(), neighbors.data(), neighbor_weights.data(),
+				neighbors.size(), neighbors.data(), neighbor_weights.data(),
+				MPI_INFO_NULL, 1, &graph_comm);
+		// The process of rank r in `graph_comm` takes the role of the
+		// partition r
+		int new_rank;
+		MPI_Comm_rank(graph_comm, &new_rank);
+		MPI_Comm_free(&graph_comm);
+
+		fpmas::communication::TypedMpi<int> mpi(model.getMpiCommunicator());
+		std::vector<int> new_ranks = mpi.gather(new_rank, 0);
+
+		std::vector<int> mapping(new_ranks.size());
+		for(std::size_t process = 0; process < new_ranks.size(); process++)
+			mapping[new_ranks[process]] = process;
+		return mapping;
+	}
+
+	std::vector<int> RankRemapping::greedy_mapping() {
+		std::size_t size = compute_nodes.size();
+
+		std::map<int, std::vector<int>> node_processes;
+		for(std::size_t process = 0; process < size; process++)
+			node_processes[compute_nodes[process]].push_back(process);
+
+		// Partitions by decreasing traffic
+		std::vector<unsigned long long> traffic(size, 0);
+		for(std::size_t p = 0; p < size; p++)
+			for(auto& weight : weights[p])
+				traffic[p] += weight.second;
+		std::vector<int> by_traffic(size);
+		std::iota(by_traffic.begin(), by_traffic.end(), 0);
+		std::stable_sort(by_traffic.begin(), by_traffic.end(),
+				[&traffic] (int p, int q) {return traffic[p] > traffic[q];});
+		auto heaviest = by_traffic.begin();
+
+		std::vector<bool> assigned(size, false);
+		std::vector<int> mapping(size);
+		for(auto& node : node_processes) {
+			const std::vector<int>& processes = node.second;
+
+			// Fills the compute node, starting from the unassigned partition
+			// with the heaviest traffic, and then adding partitions that
+			// communicate the most with partitions already on the node.
+			// Only partitions adjacent to the node are scored.
+			std::vector<int> members;
+			std::map<int, unsigned long long> scores;
+			while(members.size() < processes.size()) {
+				int best = -1;
+				unsigned long long best_score = 0;
+				for(auto& score : scores)
+					if(best == -1 || score.second > best_score) {
+						best = score.first;
+						best_score = score.second;
+					}
+				if(best == -1) {
+					while(assigned[*heaviest])
+						heaviest++;
+					best = *heaviest;
+				}
+				assigned[best] = true;
+				members.push_back(best);
+				scores.erase(best);
+				for(auto& weight : weights[best])
+					if(!assigned[weight.first])
+						scores[weight.first] += weight.second;
+			}
+
+			// Partitions already located on this node stay on their process
+			std::set<int> used;
+			std::vector<int> moved;
+			for(auto member : members)
+				if(compute_nodes[member] == node.first) {
+					mapping[member] = member;
+					used.insert(member);
+				} else {
+					moved.push_back(member);
+				}
+			auto process = processes.begin();
+			for(auto member : moved) {
+				while(used.count(*process) > 0)
+					process++;
+				mapping[member] = *process;
+				used.insert(*process);
+			}
+		}
+		return mapping;
+	}
+
+	void RankRemapping::run() {
+		if(method == NO_REMAP)
+			return;
+
+		int rank = model.getMpiCommunicator().getRank();
+		gather_weights();
+		gather_compute_nodes();
+
+		std::vector<int> mapping;
+		if(method == DIST_GRAPH)
+			// Collective operation
+			mapping = dist_graph_mapping();
+
+		std::vector<std::size_t> bytes;
+		if(rank == 0) {
+			std::vector<int> identity(compute_nodes.size());
+			std::iota(identity.begin(), identity.end(), 0);
+			std::size_t before = inter_node_bytes(identity);
+
+			switch(method) {
+				case DIST_GRAPH:
+					break;
+				case NODE_GREEDY:
+					mapping = greedy_mapping();
+					break;
+				default:
+					mapping = identity;
+			}
+			if(inter_node_bytes(mapping) >= before)
+				mapping = identity;
+			bytes = {before, inter_node_bytes(mapping)};
+		}
+		// All processes apply the mapping computed by rank 0
+		fpmas::communication::TypedMpi<std::vector<int>> mapping_mpi(
+				model.getMpiCommunicator());
+		mapping = mapping_mpi.bcast(mapping, 0);
+		fpmas::communication::TypedMpi<std::vector<std::size_t>> bytes_mpi(
+				model.getMpiCommunicator());
+		bytes = bytes_mpi.bcast(bytes, 0);
+		_inter_node_bytes_before = bytes[0];
+		_inter_node_bytes_after = bytes[1];
+
+		bool moved = false;
+		for(std::size_t p = 0; p < mapping.size(); p++)
+			if(mapping[p] != (int) p)
+				moved = true;
+		if(moved) {
+			fpmas::api::graph::PartitionMap partition;
+			if(mapping[rank] != rank)
+				for(auto node : model.graph().getLocationManager().getLocalNodes())
+					partition[node.first] = mapping[rank];
+			model.graph().distribute(partition);
+			City::topology_version++;
+		}
+	}
+}
@@ -0,0 +1,89 @@
+#ifndef MACROPOP_REMAP_H
+#define MACROPOP_REMAP_H
+
+#include "macropop.h"
+
+namespace macropop {
+
+	/**
+	 * Topology-aware relabelling of partitions to processes.
+	 *
+	 * Once the load balancing has been performed, the communication graph
+	 * between partitions is known: the weight of the edge between two
+	 * partitions is the count of CITY_TO_CITY edges between them. Processes
+	 * are however still placed in WORLD order, so that heavily communicating
+	 * partitions can be assigned to processes located on different compute
+	 * nodes.
+	 *
+	 * This task computes a new mapping from partitions to processes, either
+	 * from the reordering performed by MPI_Dist_graph_create_adjacent(), or
+	 * with a greedy algorithm that fills each compute node with the
+	 * partitions that communicate the most with partitions already
+	 * assigned to it. Partitions are then moved to their new process.
+	 *
+	 * Inter-node traffic is estimated as the count of CITY_TO_CITY edges
+	 * between partitions located on different compute nodes, multiplied by
+	 * the size of a migrated Population.
+	 *
+	 * Only non-zero weights are gathered, on rank 0, that computes the
+	 * mapping and broadcasts it to all processes. The task is collective,
+	 * and must be run by all processes.
+	 */
+	class RankRemapping : public fpmas::api::scheduler::Task {
+		private:
+			fpmas::api::model::Model& model;
+			RemapMethod method;
+			std::size_t _inter_node_bytes_before = 0;
+			std::size_t _inter_node_bytes_after = 0;
+
+			/**
+			 * Count of CITY_TO_CITY edges between the local partition and
+			 * each other partition, indexed by partition.
+			 */
+			std::map<int, unsigned long long> local_weights;
+			/**
+			 * Sparse communication graph: weights[p][q] = count of
+			 * CITY_TO_CITY edges between partitions p and q. Only gathered
+			 * on rank 0.
+			 */
+			std::vector<std::map<int, unsigned long long>> weights;
+			/**
+			 * Compute node identifier of each process. Only gathered on
+			 * rank 0.
+			 */
+			std::vector<int> compute_nodes;
+
+			void gather_weights();
+			void gather_compute_nodes();
+			std::size_t inter_node_bytes(const std::vector<int>& mapping) const;
+			std::vector<int> dist_graph_mapping();
+			std::vector<int> greedy_mapping();
+
+		public:
+			/**
+			 * @param model model to remap
+			 * @param method remapping method
+			 */
+			RankRemapping(fpmas::api::model::Model& model, RemapMethod method)
+				: model(model), method(method) {}
+
+			void run() override;
+
+			/**
+			 * Estimated inter-node bytes per migration step before the
+			 * remapping.
+			 */
+			std::size_t interNodeBytesBefore() const {
+				return _inter_node_bytes_before;
+			}
+
+			/**
+			 * Estimated inter-node bytes per migration step after the
+			 * remapping.
+			 */
+			std::size_t interNodeBytesAfter() const {
+				return _inter_node_bytes_after;
+			}
+	};
+}
+#endif
@@ -0,0 +1,246 @@
+#include "spmv.h"
+#include "fpmas/communication/communication.h"
+#include <algorithm>
+#include <map>
+
+namespace macropop {
+	using fpmas::api::graph::DistributedId;
+
+	SpmvEngine::~SpmvEngine() {
+		if(halo_comm != MPI_COMM_NULL)
+			MPI_Comm_free(&halo_comm);
+	}
+
+	void SpmvEngine::build() {
+		int size = model.getMpiCommunicator().getSize();
+
+		if(halo_comm == MPI_COMM_NULL)
+			MPI_Comm_dup(mpi_comm(model.getMpiCommunicator()), &halo_comm);
+
+		cities.clear();
+		for(auto agent : model.getGroup(CITY).localAgents())
+			cities.push_back(dynamic_cast<City*>(agent));
+		cities = rcm_order(cities);
+
+		std::map<DistributedId, std::size_t> local_rows;
+		for(std::size_t i = 0; i < cities.size(); i++)
+			local_rows[cities[i]->node()->getId()] = i;
+
+		// Distinct halo cities, grouped by owner rank
+		std::map<int, std::map<DistributedId, std::size_t>> halo;
+		for(auto city : cities)
+			for(auto edge : city->node()->getOutgoingEdges(CITY_TO_CITY)) {
+				auto target = edge->getTargetNode();
+				if(target->state() == fpmas::api::graph::DISTANT)
+					halo[target->location()][target->getId()];
+			}
+		// Assigns a column to each halo city, so that halo columns are
+		// contiguous for each owner rank
+		std::size_t column = cities.size();
+		send_counts.assign(size, 0);
+		send_displs.assign(size, 0);
+		std::unordered_map<int, std::vector<DistributedId>> requests;
+		for(auto& rank_halo : halo) {
+			send_displs[rank_halo.first] = 3 * (column - cities.size());
+			send_counts[rank_halo.first] = 3 * rank_halo.second.size();
+			for(auto& halo_city : rank_halo.second) {
+				halo_city.second = column++;
+				requests[rank_halo.first].push_back(halo_city.first);
+			}
+		}
+
+		// Builds the CSR matrix
+		populations.resize(cities.size());
+		retained.resize(cities.size());
+		row_ptr.assign(1, 0);
+		columns.clear();
+		values.clear();
+		boundary_rows.clear();
+		interior_rows.clear();
+		for(std::size_t i = 0; i < cities.size(); i++) {
+			City* city = cities[i];
+			populations[i] = city->population;
+
+			auto edges = city->node()->getOutgoingEdges(CITY_TO_CITY);
+			double m = 1. / edges.size();
+			// Fraction of the initial population that has not migrated yet,
+			// updated as City::migrate_population() sequentially migrates
+			// population to each neighbor
+			Population remaining {1, 1, 1};
+			for(auto edge : edges) {
+				auto target = edge->getTargetNode();
+				if(target->state() == fpmas::api::graph::LOCAL)
+					columns.push_back(local_rows.at(target->getId()));
+				else
+					columns.push_back(halo[target->location()].at(target->getId()));
+
+				Population coefficient {
+					City::period_rate(city->g_s) * m * remaining.S,
+					City::period_rate(city->g_i) * m * remaining.I,
+					City::period_rate(city->g_r) * m * remaining.R
+				};
+				values.push_back(coefficient);
+				remaining -= coefficient;
+			}
+			retained[i] = remaining;
+			row_ptr.push_back(columns.size());
+
+			bool boundary = false;
+			for(std::size_t k = row_ptr[i]; k < row_ptr[i+1]; k++)
+				if(columns[k] >= cities.size())
+					boundary = true;
+			if(boundary)
+				boundary_rows.push_back(i);
+			else
+				interior_rows.push_back(i);
+		}
+		inflows.resize(column);
+
+		// Each process sends to owners the list of halo cities it will
+		// send population to, in column order
+		fpmas::communication::TypedMpi<std::vector<DistributedId>> id_mpi(
+				model.getMpiCommunicator());
+		auto requested = id_mpi.allToAll(requests);
+
+		recv_counts.assign(size, 0);
+		recv_displs.assign(size, 0);
+		recv_rows.clear();
+		for(int rank = 0; rank < size; rank++) {
+			recv_displs[rank] = 3 * recv_rows.size();
+			auto ids = requested.find(rank);
+			if(ids != requested.end()) {
+				recv_counts[rank] = 3 * ids->second.size();
+				for(auto id : ids->second)
+					recv_rows.push_back(local_rows.at(id));
+			}
+		}
+		send_buffer.resize(3 * (column - cities.size()));
+		recv_buffer.resize(3 * recv_rows.size());
+
+		built_version = City::topology_version;
+	}
+
+	void SpmvEngine::start_exchange() {
+		City::comm_probe.start();
+		distant_comm_probe.start();
+
+		std::size_t halo_begin = cities.size();
+		for(std::size_t j = halo_begin; j < inflows.size(); j++) {
+			send_buffer[3*(j-halo_begin)] = inflows[j].S;
+			send_buffer[3*(j-halo_begin)+1] = inflows[j].I;
+			send_buffer[3*(j-halo_begin)+2] = inflows[j].R;
+		}
+		// Only neighbor processes are involved in the exchange
+		requests.clear();
+		for(std::size_t rank = 0; rank < recv_counts.size(); rank++)
+			if(recv_counts[rank] > 0) {
+				requests.emplace_back();
+				MPI_Irecv(
+						&recv_buffer[recv_displs[rank]], recv_counts[rank], MPI_DOUBLE,
+						rank, 0, halo_comm, &requests.back());
+			}
+		for(std::size_t rank = 0; rank < send_counts.size(); rank++)
+			if(send_counts[rank] > 0) {
+				requests.emplace_back();
+				MPI_Isend(
+						&send_buffer[send_displs[rank]], send_counts[rank], MPI_DOUBLE,
+						rank, 0, halo_comm, &requests.back());
+			}
+
+		distant_comm_probe.stop();
+		City::comm_probe.stop();
+	}
+
+	void SpmvEngine::end_exchange() {
+		City::comm_probe.start();
+		distant_comm_probe.start();
+		halo_wait_probe.start();
+
+		MPI_Waitall(requests.size(), requests.data(), MPI_STATUSES_IGNORE);
+		for(std::size_t j = 0; j < recv_rows.size(); j++)
+			inflows[recv_rows[j]] += Population(
+					recv_buffer[3*j], recv_buffer[3*j+1], recv_buffer[3*j+2]
+					);
+
+		halo_wait_probe.stop();
+		distant_comm_probe.stop();
+		City::comm_probe.stop();
+		City::monitor.commit(City::comm_probe);
+		City::monitor.commit(distant_comm_probe);
+		City::monitor.commit(halo_wait_probe);
+	}
+
+	void SpmvEngine::commit() {
+		for(std::size_t i = 0; i < cities.size(); i++)
+			cities[i]->population = populations[i];
+	}
+
+	void SpmvEngine::compute(std::size_t row) {
+		const Population& population = populations[row];
+		for(std::size_t k = row_ptr[row]; k < row_ptr[row+1]; k++) {
+			const Population& value = values[k];
+			inflows[columns[k]] += Population(
+					value.S * population.S,
+					value.I * population.I,
+					value.R * population.R
+					);
+		}
+		populations[row] = {
+			retained[row].S * population.S,
+			retained[row].I * population.I,
+			retained[row].R * population.R
+		};
+	}
+
+	void SpmvEngine::migrate() {
+		if(built_version != City::topology_version)
+			build();
+
+		City::behavior_probe.start();
+
+		for(auto& inflow : inflows)
+			inflow = {};
+		// Halo contributions are complete once all boundary rows are
+		// computed
+		for(auto row : boundary_rows)
+			compute(row);
+		start_exchange();
+
+		// Interior rows are computed while the halo exchange is in flight
+		overlap_probe.start();
+		for(auto row : interior_rows)
+			compute(row);
+		overlap_probe.stop();
+		City::monitor.commit(overlap_probe);
+
+		end_exchange();
+		for(std::size_t i = 0; i < cities.size(); i++)
+			populations[i] += inflows[i];
+		commit();
+
+		City::behavior_probe.stop();
+		City::monitor.commit(City::behavior_probe);
+	}
+
+	std::size_t SpmvEngine::memoryFootprint() const {
+		return cities.capacity() * sizeof(City*)
+			+ (populations.capacity() + retained.capacity()
+					+ values.capacity() + inflows.capacity()) * sizeof(Population)
+			+ (row_ptr.capacity() + columns.capacity() + boundary_rows.capacity()
+					+ interior_rows.capacity() + recv_rows.capacity()) * sizeof(std::size_t)
+			+ (send_counts.capacity() + send_displs.capacity()
+					+ recv_counts.capacity() + recv_displs.capacity()) * sizeof(int)
+			+ (send_buffer.capacity() + recv_buffer.capacity()) * sizeof(double)
+			+ requests.capacity() * sizeof(MPI_Request);
+	}
+
+	void SpmvEngine::propagate_virus() {
+		if(built_version != City::topology_version)
+			build();
+
+		for(auto& population : populations)
+			for(int i = 0; i < Disease::substeps; i++)
+				population = RK4::solve(alpha, beta, Disease::delta_t, population);
+		commit();
+	}
+}
@@ -0,0 +1,178 @@
+#ifndef MACROPOP_SPMV_H
+#define MACROPOP_SPMV_H
+
+#include "macropop.h"
+
+namespace macropop {
+
+	/**
+	 * Sparse matrix execution engine.
+	 *
+	 * With fixed migration rates, the migration step performed by
+	 * City::migrate_population() is linear: it can be expressed as a sparse
+	 * matrix-vector product on the S/I/R populations of all cities.
+	 *
+	 * The engine extracts the local part of the CITY_TO_CITY layer into a CSR
+	 * matrix, where each row corresponds to a local city and each column to a
+	 * local city or to a distant "halo" city. Contributions to halo cities are
+	 * sent to their owner at each step, according to an exchange plan
+	 * precomputed when the matrix is built. The SIR integration is then
+	 * performed by a batched RK4 on the local population vector.
+	 *
+	 * Local rows are split into boundary rows, that contribute to at least
+	 * one halo city, and interior rows. At each step, boundary rows are
+	 * computed first so that the halo exchange can be started with
+	 * non-blocking communications, while interior rows are computed.
+	 *
+	 * Rows are ordered with the Reverse Cuthill-McKee algorithm applied to
+	 * local CITY_TO_CITY edges, so that neighbor cities are stored close to
+	 * each other in population vectors.
+	 *
+	 * The engine runs outside of the agent machinery (no behavior, no
+	 * acquire, no graph synchronization), and City agents are only used to
+	 * initialize the engine and to store results so that outputs are
+	 * unchanged.
+	 *
+	 * Coefficients of each row reproduce the sequential migrations of
+	 * City::migrate_population(). However, all migrations are computed from
+	 * the population at the beginning of the step, when in the agent engine
+	 * a city can forward population received earlier in the same step: the
+	 * two engines are consistent, but not bit for bit identical.
+	 */
+	class SpmvEngine {
+		private:
+			fpmas::api::model::Model& model;
+			double alpha;
+			double beta;
+
+			/**
+			 * City::topology_version value at which the matrix was built.
+			 */
+			std::size_t built_version = NeighborCache::INVALID;
+			/**
+			 * Local cities, indexed by CSR row.
+			 */
+			std::vector<City*> cities;
+			/**
+			 * Local population vector.
+			 */
+			std::vector<Population> populations;
+			/**
+			 * Fraction of population that stays in each local city at each
+			 * migration step.
+			 */
+			std::vector<Population> retained;
+
+			/*
+			 * CSR matrix. Columns [0, cities.size()) correspond to local
+			 * cities, and columns [cities.size(), inflows.size()) to halo
+			 * cities, grouped by owner rank.
+			 * Values are component wise S/I/R migration coefficients.
+			 */
+			std::vector<std::size_t> row_ptr;
+			std::vector<std::size_t> columns;
+			std::vector<Population> values;
+			/**
+			 * Rows with at least one halo column.
+			 */
+			std::vector<std::size_t> boundary_rows;
+			/**
+			 * Rows with only local columns.
+			 */
+			std::vector<std::size_t> interior_rows;
+			/**
+			 * Population received by each local and halo city during the
+			 * current migration step.
+			 */
+			std::vector<Population> inflows;
+
+			/*
+			 * Halo exchange plan, counts and displacements expressed in
+			 * doubles.
+			 */
+			std::vector<int> send_counts;
+			std::vector<int> send_displs;
+			std::vector<int> recv_counts;
+			std::vector<int> recv_displs;
+			/**
+			 * Local row of each population received from the halo exchange.
+			 */
+			std::vector<std::size_t> recv_rows;
+			std::vector<double> send_buffer;
+			std::vector<double> recv_buffer;
+			std::vector<MPI_Request> requests;
+			/**
+			 * Duplicate of the model communicator, so that halo messages
+			 * can't be matched by fpmas point-to-point communications.
+			 */
+			MPI_Comm halo_comm = MPI_COMM_NULL;
+
+			fpmas::utils::perf::Probe distant_comm_probe {City::DISTANT_COMM_PROBE};
+			fpmas::utils::perf::Probe overlap_probe {City::OVERLAP_PROBE};
+			fpmas::utils::perf::Probe halo_wait_probe {City::HALO_WAIT_PROBE};
+
+			fpmas::scheduler::detail::LambdaTask migration_task {
+				[this] () {migrate();}
+			};
+			fpmas::scheduler::detail::LambdaTask disease_task {
+				[this] () {propagate_virus();}
+			};
+			fpmas::scheduler::Job _migration_job {{migration_task}};
+			fpmas::scheduler::Job _disease_job {{disease_task}};
+
+			void build();
+			void compute(std::size_t row);
+			void start_exchange();
+			void end_exchange();
+			void commit();
+
+		public:
+			/**
+			 * @param model model containing the CITY group
+			 * @param alpha SIR alpha parameter
+			 * @param beta SIR beta parameter
+			 */
+			SpmvEngine(fpmas::api::model::Model& model, double alpha, double beta)
+				: model(model), alpha(alpha), beta(beta) {}
+
+			SpmvEngine(const SpmvEngine&) = delete;
+			SpmvEngine& operator=(const SpmvEngine&) = delete;
+			~SpmvEngine();
+
+			/**
+			 * Performs a migration step of all local cities, i.e. a sparse
+			 * matrix-vector product followed by an halo exchange.
+			 *
+			 * The matrix is lazily built at the first call, so that it
+			 * reflects the partitioning produced by the initial load
+			 * balancing, and rebuilt each time City::topology_version
+			 * changes.
+			 */
+			void migrate();
+			/**
+			 * Performs Disease::substeps RK4 integration steps on all local
+			 * cities.
+			 */
+			void propagate_virus();
+
+			/**
+			 * Bytes reserved by the matrix, population vectors and halo
+			 * exchange buffers.
+			 */
+			std::size_t memoryFootprint() const;
+
+			/**
+			 * Job equivalent to the CITY group jobs.
+			 */
+			fpmas::api::scheduler::Job& migration_job() {
+				return _migration_job;
+			}
+			/**
+			 * Job equivalent to the DISEASE group jobs.
+			 */
+			fpmas::api::scheduler::Job& disease_job() {
+				return _disease_job;
+			}
+	};
+}
+#endif